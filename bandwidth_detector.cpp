@@ -0,0 +1,105 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include "bandwidth_detector.hpp"
+
+namespace eolian {
+namespace stream {
+/******************************************************************************
+ * Class BandwidthDetector                                                    *
+ ******************************************************************************/
+
+constexpr size_t BandwidthDetector::FFT_SIZE;
+constexpr size_t BandwidthDetector::INTERVAL;
+constexpr double BandwidthDetector::THRESHOLD;
+
+BandwidthDetector::BandwidthDetector(size_t rate, size_t channels,
+                                     size_t frame_size)
+    : m_rate(rate),
+      m_channels(channels),
+      m_hop(std::max(INTERVAL * frame_size, FFT_SIZE)),
+      m_spectrum(FFT_SIZE),
+      m_window_power(m_spectrum.n_bins()),
+      m_power(m_spectrum.n_bins(), 0.0)
+{
+}
+
+void BandwidthDetector::reset()
+{
+	std::fill(m_power.begin(), m_power.end(), 0.0);
+}
+
+void BandwidthDetector::analyse(const float *src, size_t n_src)
+{
+	// Analyse a window every m_hop samples. If the signal is shorter than a
+	// single window, analyse the zero-padded signal.
+	size_t i = 0;
+	do {
+		m_spectrum.compute(src + i * m_channels, n_src - i, m_channels,
+		                   m_window_power.data());
+		for (size_t j = 0; j < m_power.size(); j++) {
+			m_power[j] += m_window_power[j];
+		}
+		i += m_hop;
+	} while (i + FFT_SIZE <= n_src);
+}
+
+float BandwidthDetector::cutoff() const
+{
+	// Compute the total energy, ignoring the DC component
+	double total = 0.0;
+	for (size_t i = 1; i < m_power.size(); i++) {
+		total += m_power[i];
+	}
+	const float nyquist = 0.5f * m_rate;
+	if (total <= 0.0) {
+		return nyquist;
+	}
+
+	// Search the lowest bin for which the energy above it is below the
+	// threshold
+	double above = 0.0;
+	size_t i = m_power.size() - 1;
+	while (i > 1 && above + m_power[i] < THRESHOLD * total) {
+		above += m_power[i];
+		i--;
+	}
+	return std::min(nyquist, float(i + 1) * m_rate / FFT_SIZE);
+}
+
+Encoder::Bandwidth BandwidthDetector::bandwidth() const
+{
+	const float f = cutoff();
+	if (f <= 4000.0f) {
+		return Encoder::Bandwidth::NARROWBAND;
+	}
+	else if (f <= 6000.0f) {
+		return Encoder::Bandwidth::MEDIUMBAND;
+	}
+	else if (f <= 8000.0f) {
+		return Encoder::Bandwidth::WIDEBAND;
+	}
+	else if (f <= 12000.0f) {
+		return Encoder::Bandwidth::SUPERWIDEBAND;
+	}
+	return Encoder::Bandwidth::FULLBAND;
+}
+}
+}
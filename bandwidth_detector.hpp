@@ -0,0 +1,121 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file bandwidth_detector.hpp
+ *
+ * Declares the BandwidthDetector class which estimates the effective audio
+ * bandwidth of a signal, e.g. the lowpass frequency of a lossy source.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "encoder.hpp"
+#include "power_spectrum.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The BandwidthDetector class computes the average power spectrum of a signal
+ * using a single FFT (see PowerSpectrum) every few frames and determines the cutoff frequency
+ * above which the signal contains (almost) no energy. The cutoff is mapped
+ * to the narrowest Opus bandwidth that still covers it, which can be passed
+ * to Encoder::Settings::max_bandwidth().
+ */
+class BandwidthDetector {
+private:
+	size_t m_rate;
+	size_t m_channels;
+
+	/**
+	 * Distance between two analysis windows in samples.
+	 */
+	size_t m_hop;
+
+	/**
+	 * FFT used to compute the power spectrum of each window and buffer
+	 * holding the result.
+	 */
+	PowerSpectrum m_spectrum;
+	std::vector<float> m_window_power;
+
+	/**
+	 * Accumulated power spectrum.
+	 */
+	std::vector<double> m_power;
+
+public:
+	/**
+	 * Number of samples in each FFT window.
+	 */
+	static constexpr size_t FFT_SIZE = 2048;
+
+	/**
+	 * Number of frames between two FFT windows.
+	 */
+	static constexpr size_t INTERVAL = 4;
+
+	/**
+	 * Fraction of the total energy that may be above the cutoff frequency
+	 * (-60 dB).
+	 */
+	static constexpr double THRESHOLD = 1e-6;
+
+	/**
+	 * Creates a new BandwidthDetector instance.
+	 *
+	 * @param rate is the sample rate of the signal.
+	 * @param channels is the number of interleaved channels.
+	 * @param frame_size is the number of samples in an Opus frame. One FFT is
+	 * computed every INTERVAL frames.
+	 */
+	BandwidthDetector(size_t rate, size_t channels, size_t frame_size);
+
+	/**
+	 * Discards the accumulated power spectrum.
+	 */
+	void reset();
+
+	/**
+	 * Adds the power spectrum of the given signal to the accumulated power
+	 * spectrum.
+	 *
+	 * @param src is a pointer at the interleaved samples.
+	 * @param n_src is the number of multi-channel samples.
+	 */
+	void analyse(const float *src, size_t n_src);
+
+	/**
+	 * Returns the frequency in Hz above which the accumulated power spectrum
+	 * contains less than THRESHOLD of the total energy. Returns the Nyquist
+	 * frequency if the signal is silent.
+	 */
+	float cutoff() const;
+
+	/**
+	 * Returns the narrowest Opus bandwidth covering the cutoff frequency.
+	 */
+	Encoder::Bandwidth bandwidth() const;
+};
+}
+}
@@ -0,0 +1,223 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "bit_budget.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The BitBudgetError class is used to signal that the size target cannot be
+ * met.
+ */
+class BitBudgetError : public std::runtime_error {
+public:
+	BitBudgetError(const std::string &msg) : std::runtime_error(msg) {}
+};
+
+/**
+ * Computes the complexity of a frame from the power of the LPC residual of
+ * each channel.
+ *
+ * @param lpc is the linear predictive coder used to compute the residual.
+ * @param buf is the interleaved frame, zero-padded beyond n_src samples.
+ * @param n_buf is the number of samples in the frame buffer.
+ * @param n_src is the number of actual samples in the frame.
+ * @param channels is the number of interleaved channels.
+ */
+static double frame_complexity(LinearPredictiveCoder &lpc, const float *buf,
+                               size_t n_buf, size_t n_src, size_t channels)
+{
+	double complexity = 0.0;
+	for (size_t i = 0; i < channels; i++) {
+		lpc.extract_coefficients(buf + i, n_buf, channels);
+		const double power = lpc.residual_energy() / n_src;
+		if (power > BitBudget::NOISE_FLOOR) {
+			complexity += 0.5 * std::log2(power / BitBudget::NOISE_FLOOR);
+		}
+	}
+	return complexity;
+}
+
+/******************************************************************************
+ * Class BitBudget                                                            *
+ ******************************************************************************/
+
+BitBudget::BitBudget(const ChunkTranscoder::Settings &settings)
+    : m_settings(settings),
+      m_planner(settings),
+      m_buf(settings.frame_size() * settings.channels())
+{
+}
+
+size_t BitBudget::chunk_idx(size_t frame_offs, size_t idx) const
+{
+	while (frame_offs >= m_planner.offs_end_for_block_idx_samples(idx)) {
+		idx++;
+	}
+	return idx;
+}
+
+void BitBudget::analyse_frame()
+{
+	// Advance to the chunk the frame starts in
+	m_idx = chunk_idx(m_offs - m_buf_ptr, m_idx);
+	if (m_idx >= m_complexity_sum.size()) {
+		m_complexity_sum.resize(m_idx + 1, 0.0);
+		m_n_frames.resize(m_idx + 1, 0);
+	}
+
+	m_complexity_sum[m_idx] += frame_complexity(
+	    m_lpc, m_buf.data(), m_buf_ptr, m_buf_ptr, m_settings.channels());
+	m_n_frames[m_idx]++;
+	m_buf_ptr = 0;
+}
+
+void BitBudget::analyse(const float *src, size_t n_src)
+{
+	const size_t channels = m_settings.channels();
+	const size_t fs = m_settings.frame_size();
+	while (n_src > 0) {
+		const size_t n = std::min(fs - m_buf_ptr, n_src);
+		std::copy(src, src + n * channels, m_buf.data() + m_buf_ptr * channels);
+		m_buf_ptr += n;
+		m_offs += n;
+		src += n * channels;
+		n_src -= n;
+		if (m_buf_ptr == fs) {
+			analyse_frame();
+		}
+	}
+}
+
+std::vector<double> BitBudget::complexity() const
+{
+	std::vector<double> sum = m_complexity_sum;
+	std::vector<size_t> n_frames = m_n_frames;
+
+	// Account for the trailing samples that do not fill an entire frame,
+	// otherwise a short last chunk would not be assigned a complexity
+	if (m_buf_ptr > 0) {
+		const size_t idx = chunk_idx(m_offs - m_buf_ptr, m_idx);
+		if (idx >= sum.size()) {
+			sum.resize(idx + 1, 0.0);
+			n_frames.resize(idx + 1, 0);
+		}
+		std::vector<float> buf(m_buf.size(), 0.0f);
+		std::copy(m_buf.begin(),
+		          m_buf.begin() + m_buf_ptr * m_settings.channels(),
+		          buf.begin());
+		LinearPredictiveCoder lpc;
+		sum[idx] += frame_complexity(lpc, buf.data(), m_settings.frame_size(),
+		                             m_buf_ptr, m_settings.channels());
+		n_frames[idx]++;
+	}
+
+	std::vector<double> res(sum.size(), 0.0);
+	for (size_t i = 0; i < res.size(); i++) {
+		if (n_frames[i] > 0) {
+			res[i] = sum[i] / n_frames[i];
+		}
+	}
+	return res;
+}
+
+std::vector<size_t> BitBudget::allocate(size_t total_bytes) const
+{
+	// Compute the complexity and the duration of each chunk. Each chunk is
+	// extended by two frames to account for the lead-in and the padding.
+	const std::vector<double> c = complexity();
+	const size_t n_chunks = c.size();
+	const size_t fs = m_settings.frame_size();
+	std::vector<double> duration(n_chunks);
+	size_t n_packets = 0;
+	for (size_t i = 0; i < n_chunks; i++) {
+		const size_t offs = m_planner.offs_for_block_idx_samples(i);
+		const size_t offs_end =
+		    std::min(m_offs, m_planner.offs_end_for_block_idx_samples(i));
+		const size_t length = std::max(offs_end, offs) - offs + 2 * fs;
+		duration[i] = double(length) / m_settings.rate();
+		n_packets += (length + fs * m_settings.packet_frames() - 1) /
+		             (fs * m_settings.packet_frames());
+	}
+
+	// Subtract the estimated container overhead from the budget
+	const double overhead =
+	    double(n_chunks * CHUNK_OVERHEAD + n_packets * PACKET_OVERHEAD);
+	const double budget = std::max(0.0, double(total_bytes) - overhead) * 8.0;
+
+	// Chunks without measurable complexity still need a minimum bitrate
+	const double min_bitrate = m_settings.min_bitrate();
+	const double max_bitrate = 512000.0;
+	auto bitrate = [&](size_t i, double scale) {
+		return std::min(max_bitrate, std::max(min_bitrate, c[i] * scale));
+	};
+	auto total_bits = [&](double scale) {
+		double res = 0.0;
+		for (size_t i = 0; i < n_chunks; i++) {
+			res += bitrate(i, scale) * duration[i];
+		}
+		return res;
+	};
+
+	// Even if all chunks are encoded at the minimum bitrate, the size target
+	// cannot be met
+	if (n_chunks > 0 && total_bits(0.0) > budget) {
+		throw BitBudgetError(
+		    "Size target cannot be met at the minimum bitrate");
+	}
+
+	// The total number of bits is monotonic in the scale factor, search for
+	// the scale factor hitting the budget using bisection
+	double lo = 0.0, hi = max_bitrate;
+	while (total_bits(hi) < budget && hi < 1e12) {
+		hi *= 2.0;
+	}
+	for (size_t iter = 0; iter < 64; iter++) {
+		const double mid = 0.5 * (lo + hi);
+		if (total_bits(mid) > budget) {
+			hi = mid;
+		}
+		else {
+			lo = mid;
+		}
+	}
+
+	std::vector<size_t> res(n_chunks);
+	for (size_t i = 0; i < n_chunks; i++) {
+		res[i] = bitrate(i, lo);
+	}
+	return res;
+}
+
+double BitBudget::overshoot(size_t total_bytes,
+                            const std::vector<ChunkTranscoder::Chunk> &chunks)
+{
+	size_t encoded_bytes = 0;
+	for (const ChunkTranscoder::Chunk &chunk : chunks) {
+		encoded_bytes += chunk.size;
+	}
+	return (double(encoded_bytes) - double(total_bytes)) /
+	       std::max<size_t>(1, total_bytes);
+}
+}
+}
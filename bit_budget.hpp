@@ -0,0 +1,185 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file bit_budget.hpp
+ *
+ * Declares the BitBudget class which distributes a total size budget across
+ * the chunks of a stream.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "chunk_planner.hpp"
+#include "chunk_transcoder.hpp"
+#include "lpc.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The BitBudget class implements the first pass of a two-pass encode. The
+ * entire stream is passed to analyse(), which estimates the coding complexity
+ * of each chunk from the residual of a linear predictive coder: following the
+ * rate-distortion function of a Gaussian source, each frame is assigned
+ * 0.5 * log2(residual power / noise floor) bits per sample. allocate() then
+ * assigns each chunk a bitrate proportional to its complexity such that the
+ * encoded stream hits a total size target. The resulting bitrates are passed
+ * to the second pass using ChunkTranscoder::Settings::chunk_bitrates().
+ */
+class BitBudget {
+private:
+	/**
+	 * Settings the chunks will be encoded with.
+	 */
+	ChunkTranscoder::Settings m_settings;
+
+	/**
+	 * Planner used to assign analysis frames to chunks.
+	 */
+	ChunkPlanner m_planner;
+
+	/**
+	 * Linear predictive coder used to compute the prediction residual.
+	 */
+	LinearPredictiveCoder m_lpc;
+
+	/**
+	 * Buffer holding the samples of the current analysis frame.
+	 */
+	std::vector<float> m_buf;
+
+	/**
+	 * Number of samples in the analysis frame buffer.
+	 */
+	size_t m_buf_ptr = 0;
+
+	/**
+	 * Number of samples analysed so far.
+	 */
+	size_t m_offs = 0;
+
+	/**
+	 * Index of the chunk the current analysis frame is assigned to.
+	 */
+	size_t m_idx = 0;
+
+	/**
+	 * Sum of the per-frame complexity and number of frames for each chunk.
+	 */
+	std::vector<double> m_complexity_sum;
+	std::vector<size_t> m_n_frames;
+
+	/**
+	 * Returns the index of the chunk the frame starting at the given offset
+	 * is assigned to, starting the search at the given chunk index.
+	 */
+	size_t chunk_idx(size_t frame_offs, size_t idx) const;
+
+	/**
+	 * Analyses the frame in the frame buffer.
+	 */
+	void analyse_frame();
+
+public:
+	/**
+	 * Power of the residual (w.r.t. a full-scale signal) which is assumed to
+	 * be inaudible. Frames with a residual below this value have no
+	 * complexity.
+	 */
+	static constexpr double NOISE_FLOOR = 1e-7;
+
+	/**
+	 * Estimated container overhead of a chunk in bytes, not counting the
+	 * per-packet overhead.
+	 */
+	static constexpr size_t CHUNK_OVERHEAD = 200;
+
+	/**
+	 * Estimated container overhead per Opus packet in bytes.
+	 */
+	static constexpr size_t PACKET_OVERHEAD = 3;
+
+	/**
+	 * Creates a new BitBudget instance.
+	 *
+	 * @param settings are the settings used to encode the chunks in the
+	 * second pass.
+	 */
+	BitBudget(const ChunkTranscoder::Settings &settings);
+
+	/**
+	 * Analyses the next samples of the stream.
+	 *
+	 * @param src is a pointer at the interleaved samples.
+	 * @param n_src is the number of multi-channel samples.
+	 */
+	void analyse(const float *src, size_t n_src);
+
+	/**
+	 * Returns the total number of samples passed to analyse().
+	 */
+	size_t length() const { return m_offs; }
+
+	/**
+	 * Returns the estimated complexity of each chunk in bits per sample.
+	 * Trailing samples that do not fill an entire frame are analysed as a
+	 * zero-padded frame.
+	 */
+	std::vector<double> complexity() const;
+
+	/**
+	 * Computes the bitrate of each chunk such that the total size of all
+	 * chunks is approximately the given number of bytes. Bitrates are
+	 * proportional to the complexity of each chunk and clamped to the range
+	 * between Settings::min_bitrate() and 512000. Throws an exception if the
+	 * size target cannot be met even if all chunks are encoded at
+	 * Settings::min_bitrate().
+	 *
+	 * Note that the resulting size is only an estimate: the encoder does not
+	 * hit the requested bitrates exactly and the container overhead is
+	 * approximated. Hard size limits require some headroom and should be
+	 * verified after encoding.
+	 *
+	 * @param total_bytes is the target size of all chunks.
+	 * @return the bitrate of each chunk in bits per second.
+	 */
+	std::vector<size_t> allocate(size_t total_bytes) const;
+
+	/**
+	 * Compares the size of the encoded chunks against the size target that
+	 * was passed to allocate(). Since the allocation is open-loop, this should
+	 * be checked after the second pass; if the target is exceeded, allocate()
+	 * may be called again with a correspondingly reduced target.
+	 *
+	 * @param total_bytes is the target size of all chunks.
+	 * @param chunks are the metadata of the encoded chunks as returned by
+	 * ChunkTranscoder::last_chunk(). Chunk::size must be known.
+	 * @return the relative deviation of the encoded size from the target,
+	 * e.g. 0.05 if the chunks are five percent larger than the target.
+	 * Negative if the chunks are smaller than the target.
+	 */
+	static double overshoot(size_t total_bytes,
+	                        const std::vector<ChunkTranscoder::Chunk> &chunks);
+};
+}
+}
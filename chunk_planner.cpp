@@ -0,0 +1,137 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+#include "chunk_planner.hpp"
+
+namespace eolian {
+namespace stream {
+/******************************************************************************
+ * Class ChunkPlanner                                                         *
+ ******************************************************************************/
+
+ChunkPlanner::ChunkPlanner(const ChunkTranscoder::Settings &settings)
+    : m_rate(settings.rate()),
+      m_overlap(settings.overlap_samples()),
+      m_seek_interval(settings.seek_interval_samples())
+{
+	// Compute the length of each scheduled chunk in samples
+	std::vector<size_t> lengths;
+	for (float length : settings.schedule()) {
+		lengths.push_back(length * m_rate);
+	}
+	m_step = lengths.back() + m_overlap;
+
+	// Without seek points, store the boundaries up to the steady state
+	m_bounds.push_back(0);
+	if (m_seek_interval == 0) {
+		for (size_t i = 0; i + 1 < lengths.size(); i++) {
+			m_bounds.push_back(m_bounds.back() + lengths[i] + m_overlap);
+		}
+		return;
+	}
+
+	// Otherwise store all boundaries within one seek interval
+	assert(m_seek_interval > m_overlap);
+	for (size_t i = 0; true; i++) {
+		const size_t length = lengths[std::min(i, lengths.size() - 1)];
+		const size_t next = m_bounds.back() + length + m_overlap;
+		if (next >= m_seek_interval) {
+			// Merge a short remainder at the end of the interval into the
+			// previous chunk
+			if (m_bounds.size() > 1 &&
+			    (m_seek_interval - m_bounds.back()) < (length / 2)) {
+				m_bounds.back() = m_seek_interval;
+			}
+			else {
+				m_bounds.push_back(m_seek_interval);
+			}
+			break;
+		}
+		m_bounds.push_back(next);
+	}
+}
+
+size_t ChunkPlanner::boundary(size_t k) const
+{
+	if (k < m_bounds.size()) {
+		return m_bounds[k];
+	}
+	assert(m_seek_interval == 0);
+	return m_bounds.back() + (k - m_bounds.size() + 1) * m_step;
+}
+
+size_t ChunkPlanner::offs_for_block_idx_samples(size_t idx) const
+{
+	size_t base = 0;
+	if (m_seek_interval > 0) {
+		base = (idx / chunks_per_interval()) * m_seek_interval;
+		idx = idx % chunks_per_interval();
+	}
+	return std::max<int64_t>(int64_t(base + boundary(idx)) - int64_t(m_overlap),
+	                         0);
+}
+
+size_t ChunkPlanner::offs_end_for_block_idx_samples(size_t idx) const
+{
+	size_t base = 0;
+	if (m_seek_interval > 0) {
+		base = (idx / chunks_per_interval()) * m_seek_interval;
+		idx = idx % chunks_per_interval();
+	}
+	return base + boundary(idx + 1);
+}
+
+size_t ChunkPlanner::block_idx_for_offs_samples(size_t offs) const
+{
+	// The first block always starts at zero
+	if (offs == 0) {
+		return 0;
+	}
+
+	// Search for the first boundary at or after the given offset plus the
+	// overlap, relative to the last seek point
+	size_t x = offs + m_overlap, base_idx = 0;
+	if (m_seek_interval > 0) {
+		base_idx = (x / m_seek_interval) * chunks_per_interval();
+		x = x % m_seek_interval;
+	}
+	const auto it = std::lower_bound(m_bounds.begin(), m_bounds.end(), x);
+	if (it != m_bounds.end()) {
+		return base_idx + (it - m_bounds.begin());
+	}
+
+	// The offset is in the steady-state region
+	assert(m_seek_interval == 0);
+	const size_t n = m_bounds.size() - 1;
+	return n + (x - m_bounds.back() + m_step - 1) / m_step;
+}
+
+size_t ChunkPlanner::max_length_samples() const
+{
+	size_t res = m_step + m_overlap;
+	for (size_t i = 0; i + 1 < m_bounds.size(); i++) {
+		res = std::max(res, m_bounds[i + 1] - m_bounds[i] + m_overlap);
+	}
+	return res;
+}
+}
+}
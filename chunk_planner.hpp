@@ -0,0 +1,134 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file chunk_planner.hpp
+ *
+ * Declares the ChunkPlanner class which computes the position of each chunk
+ * within the original audio stream from the ChunkTranscoder settings.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "chunk_transcoder.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The ChunkPlanner class computes the nominal start and end offset of each
+ * chunk given the overlap, chunk length schedule and seek interval stored in
+ * the ChunkTranscoder::Settings. The chunk with index k covers the samples
+ * from b(k) - overlap to b(k + 1), where b(k) is the k-th chunk boundary.
+ * Within each seek interval the distance between two boundaries is the
+ * scheduled length of the chunk plus the overlap.
+ */
+class ChunkPlanner {
+private:
+	/**
+	 * Sample rate used to convert between samples and seconds.
+	 */
+	size_t m_rate;
+
+	/**
+	 * Overlap between two chunks in samples.
+	 */
+	size_t m_overlap;
+
+	/**
+	 * Interval between seek points in samples or zero if the schedule only
+	 * starts at the beginning of the stream.
+	 */
+	size_t m_seek_interval;
+
+	/**
+	 * Chunk boundaries relative to the last seek point. If there are seek
+	 * points, the last element is the seek interval itself, otherwise the
+	 * last element is the start of the steady-state chunk length.
+	 */
+	std::vector<size_t> m_bounds;
+
+	/**
+	 * Distance between two boundaries in the steady state in samples.
+	 */
+	size_t m_step;
+
+	/**
+	 * Returns the k-th chunk boundary relative to the last seek point.
+	 */
+	size_t boundary(size_t k) const;
+
+	/**
+	 * Returns the number of chunks between two seek points.
+	 */
+	size_t chunks_per_interval() const { return m_bounds.size() - 1; }
+
+public:
+	/**
+	 * Creates a new ChunkPlanner instance for the given settings.
+	 */
+	ChunkPlanner(const ChunkTranscoder::Settings &settings);
+
+	/**
+	 * Returns the offset in seconds an audio block with the given index
+	 * would start at (including overlap).
+	 */
+	float offs_for_block_idx(size_t idx) const
+	{
+		return offs_for_block_idx_samples(idx) / float(m_rate);
+	}
+
+	/**
+	 * Returns the offset in samples an audio block with the given index
+	 * would start at (including overlap).
+	 */
+	size_t offs_for_block_idx_samples(size_t idx) const;
+
+	/**
+	 * Returns the offset in seconds an audio block with the given index
+	 * would end at (including overlap).
+	 */
+	float offs_end_for_block_idx(size_t idx) const
+	{
+		return offs_end_for_block_idx_samples(idx) / float(m_rate);
+	}
+
+	/**
+	 * Returns the offset in samples an audio block with the given index
+	 * would end at (including overlap).
+	 */
+	size_t offs_end_for_block_idx_samples(size_t idx) const;
+
+	/**
+	 * Returns the index of the first block starting at or after the given
+	 * offset in samples.
+	 */
+	size_t block_idx_for_offs_samples(size_t offs) const;
+
+	/**
+	 * Returns the maximum total length (i.e. including the overlap at the
+	 * beginning and the end) of a single chunk in samples.
+	 */
+	size_t max_length_samples() const;
+};
+}
+}
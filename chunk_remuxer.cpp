@@ -0,0 +1,181 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <string>
+
+#include "chunk_planner.hpp"
+#include "chunk_remuxer.hpp"
+#include "ogg_opus_index.hpp"
+#include "ogg_opus_muxer.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The ChunkRemuxerError class is used to signal that the source stream cannot
+ * be split into chunks.
+ */
+class ChunkRemuxerError : public std::runtime_error {
+public:
+	ChunkRemuxerError(const std::string &msg) : std::runtime_error(msg) {}
+};
+
+/******************************************************************************
+ * Struct ChunkRemuxer::Impl                                                  *
+ ******************************************************************************/
+
+struct ChunkRemuxer::Impl {
+	/**
+	 * Parameters describing the chunk layout.
+	 */
+	ChunkTranscoder::Settings settings;
+
+	/**
+	 * Computes the nominal position of each chunk from the settings.
+	 */
+	ChunkPlanner planner;
+
+	/**
+	 * Packets and properties of the source stream.
+	 */
+	OggOpusIndex index;
+
+	/**
+	 * Index of the next chunk and flag indicating whether the last chunk has
+	 * been written.
+	 */
+	size_t idx = 0;
+	bool at_end = false;
+
+	/**
+	 * Metadata of the last chunk.
+	 */
+	ChunkTranscoder::Chunk chunk;
+
+	Impl(const uint8_t *src, size_t size,
+	     const ChunkTranscoder::Settings &settings)
+	    : settings(settings), planner(settings), index(src, size)
+	{
+		assert(settings.rate() == 48000);
+		assert(!settings.headerless());
+		this->settings.channels(index.channels());
+	}
+
+	bool remux(std::ostream &os)
+	{
+		// Determine the chunk boundaries just like the ChunkTranscoder
+		if (at_end) {
+			return false;
+		}
+		const size_t overlap = settings.overlap_samples();
+		const size_t offs = planner.offs_for_block_idx_samples(idx);
+		if (offs >= index.length()) {
+			at_end = true;
+			return false;
+		}
+		size_t crossfade_in = (offs == 0) ? 0 : overlap;
+		size_t crossfade_out = overlap;
+		size_t offs_end = planner.offs_end_for_block_idx_samples(idx);
+		if (index.length() < offs_end) {
+			offs_end = index.length();
+			crossfade_out = 0;
+			at_end = true;
+		}
+
+		// Select the packets covering the chunk and the pre-roll
+		const size_t pos = offs + index.pre_skip();
+		const size_t pos_end = offs_end + index.pre_skip();
+		const size_t first =
+		    index.packet_at(pos > PRE_ROLL ? pos - PRE_ROLL : 0);
+		const size_t last = index.packet_at(pos_end - 1);
+		const size_t start = index.packet(first).start;
+		const size_t chunk_pre_skip = pos - start;
+		if (chunk_pre_skip > 0xFFFF) {
+			throw ChunkRemuxerError("Packets too long for the pre_skip field");
+		}
+
+		// Copy the packets, the granule of the last packet trims the decoded
+		// audio to the chunk end
+		size_t n_bytes = 0;
+		{
+			OggOpusMuxer muxer(
+			    os, chunk_pre_skip, index.vendor(),
+			    {{"CF_IN", std::to_string(crossfade_in)},
+			     {"CF_OUT", std::to_string(crossfade_out)}},
+			    index.channels(), index.rate(), true, 0, index.mapping());
+			for (size_t i = first; i <= last; i++) {
+				const OggOpusIndex::Packet packet = index.packet(i);
+				const bool is_last = i == last;
+				const size_t granule =
+				    is_last ? chunk_pre_skip + (offs_end - offs)
+				            : packet.start + packet.duration - start;
+				muxer.write_frame(is_last, granule, packet.data, packet.size);
+				n_bytes += packet.size;
+			}
+		}
+
+		// Remember the chunk metadata
+		const OggOpusIndex::Packet last_packet = index.packet(last);
+		const size_t duration =
+		    last_packet.start + last_packet.duration - start;
+		chunk.idx = idx;
+		chunk.offs = offs;
+		chunk.length = offs_end - offs;
+		chunk.crossfade_in = crossfade_in;
+		chunk.crossfade_out = crossfade_out;
+		chunk.channels = index.channels();
+		chunk.bitrate = n_bytes * 8 * 48000 / duration;
+		idx++;
+		return true;
+	}
+};
+
+/******************************************************************************
+ * Class ChunkRemuxer                                                         *
+ ******************************************************************************/
+
+constexpr size_t ChunkRemuxer::PRE_ROLL;
+
+ChunkRemuxer::ChunkRemuxer(const uint8_t *data, size_t size,
+                           const ChunkTranscoder::Settings &settings)
+    : m_impl(std::make_unique<Impl>(data, size, settings))
+{
+}
+
+ChunkRemuxer::~ChunkRemuxer()
+{
+	// Implicitly destroy m_impl
+}
+
+bool ChunkRemuxer::remux(std::ostream &os) { return m_impl->remux(os); }
+
+size_t ChunkRemuxer::length() const { return m_impl->index.length(); }
+
+const ChunkTranscoder::Chunk &ChunkRemuxer::last_chunk() const
+{
+	return m_impl->chunk;
+}
+
+ChunkTranscoder::Settings ChunkRemuxer::settings() const
+{
+	return m_impl->settings;
+}
+}
+}
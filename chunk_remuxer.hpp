@@ -0,0 +1,119 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file chunk_remuxer.hpp
+ *
+ * Declares the ChunkRemuxer class which splits an existing Ogg/Opus stream
+ * into overlapping chunks without re-encoding the audio.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+
+#include "chunk_transcoder.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The ChunkRemuxer class produces the same chunk layout as the
+ * ChunkTranscoder from an existing Ogg/Opus stream by copying the original
+ * Opus packets. Each chunk consists of all packets overlapping the chunk,
+ * preceded by packets covering at least PRE_ROLL samples, during which the
+ * freshly reset decoder converges. The pre-roll and the part of the first
+ * packet before the chunk start are discarded using the pre_skip field of
+ * the id header, the part of the last packet after the chunk end is
+ * discarded using the granule position of the last page. Crossfades are
+ * stored in the CF_IN and CF_OUT tags just as in transcoded chunks.
+ *
+ * Only the chunk layout settings (overlap, length schedule and seek
+ * interval) of the ChunkTranscoder::Settings are used. Since the pre_skip
+ * differs between chunks, header-less chunks are not supported. Positions are
+ * measured at 48000 samples/s, the time basis of the Ogg/Opus granules.
+ */
+class ChunkRemuxer {
+private:
+	/**
+	 * Actual implementation of the ChunkRemuxer class.
+	 */
+	struct Impl;
+	std::unique_ptr<Impl> m_impl;
+
+public:
+	/**
+	 * Number of samples decoded and discarded before the start of each chunk
+	 * (80 ms), which is the amount of pre-roll recommended by RFC 7845 when
+	 * seeking within an Opus stream.
+	 */
+	static constexpr size_t PRE_ROLL = 3840;
+
+	/**
+	 * Demuxes the given Ogg/Opus stream. Throws an exception if the stream is
+	 * malformed.
+	 *
+	 * @param data is a pointer at the Ogg/Opus stream including its headers.
+	 * The packets are copied, so the buffer does not need to outlive the
+	 * ChunkRemuxer instance.
+	 * @param size is the size of the stream in bytes.
+	 * @param settings describes the chunk layout. The sample rate must be
+	 * 48000 and header-less mode must be disabled. The number of channels is
+	 * taken from the stream.
+	 */
+	ChunkRemuxer(const uint8_t *data, size_t size,
+	             const ChunkTranscoder::Settings &settings =
+	                 ChunkTranscoder::Settings());
+
+	/**
+	 * Destroys the ChunkRemuxer instance.
+	 */
+	~ChunkRemuxer();
+
+	/**
+	 * Writes the next chunk to the given output stream.
+	 *
+	 * @param os is the output stream the chunk should be written to.
+	 * @return true if a valid chunk was written to the output stream, false
+	 * if the end of the source stream has been reached.
+	 */
+	bool remux(std::ostream &os);
+
+	/**
+	 * Returns the number of samples in the source stream.
+	 */
+	size_t length() const;
+
+	/**
+	 * Returns a reference at the metadata of the last chunk that was written.
+	 * The bitrate is the average bitrate of the copied packets.
+	 */
+	const ChunkTranscoder::Chunk &last_chunk() const;
+
+	/**
+	 * Returns the settings, with the number of channels set to the number of
+	 * channels of the source stream.
+	 */
+	ChunkTranscoder::Settings settings() const;
+};
+}
+}
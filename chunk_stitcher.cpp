@@ -0,0 +1,507 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "chunk_stitcher.hpp"
+#include "chunk_validator.hpp"
+#include "encoder.hpp"
+#include "ogg_opus_demuxer.hpp"
+#include "ogg_opus_index.hpp"
+#include "ogg_opus_muxer.hpp"
+#include "opus_reader.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The ChunkStitcherError class is used to signal that the chunks cannot be
+ * joined.
+ */
+class ChunkStitcherError : public std::runtime_error {
+public:
+	ChunkStitcherError(const std::string &msg) : std::runtime_error(msg) {}
+};
+
+/******************************************************************************
+ * Struct ChunkStitcher::Impl                                                 *
+ ******************************************************************************/
+
+struct ChunkStitcher::Impl {
+	/**
+	 * Frame sizes the seams are encoded with. The bulk of a seam is encoded
+	 * with 20 ms frames, the remainder with 2.5 ms frames. All Opus packet
+	 * durations are multiples of MIN_FRAME_SIZE.
+	 */
+	static constexpr size_t FRAME_SIZE = 960;
+	static constexpr size_t MIN_FRAME_SIZE = 120;
+
+	/**
+	 * A single chunk along with its position in the stitched stream.
+	 */
+	struct Chunk {
+		std::shared_ptr<const OggOpusIndex> index;
+		std::unique_ptr<OpusReader> reader;
+
+		/**
+		 * Position of the first sample after the pre_skip in the stitched
+		 * stream and number of samples in the chunk.
+		 */
+		int64_t offs;
+		size_t length;
+
+		/**
+		 * Crossfades at 48000 samples/s.
+		 */
+		size_t crossfade_in;
+		size_t crossfade_out;
+
+		/**
+		 * Average bitrate of the chunk, used when re-encoding the seams.
+		 */
+		size_t bitrate;
+
+		/**
+		 * Returns the position of the given packet in the stitched stream,
+		 * index.size() refers to the end of the last packet.
+		 */
+		int64_t packet_pos(size_t k) const
+		{
+			const size_t n = index->size();
+			const OggOpusIndex::Packet p = index->packet(std::min(k, n - 1));
+			return offs + int64_t(p.start + ((k < n) ? 0 : p.duration)) -
+			       int64_t(index->pre_skip());
+		}
+
+		/**
+		 * Returns the index of the last packet starting at or before the
+		 * given position in the stitched stream.
+		 */
+		size_t packet_before(int64_t pos) const
+		{
+			const int64_t p = pos - offs + int64_t(index->pre_skip());
+			return index->packet_at(size_t(std::max<int64_t>(p, 0)));
+		}
+
+		/**
+		 * Returns the index of the first packet starting at or after the
+		 * given position in the stitched stream, or index.size() if there is
+		 * no such packet.
+		 */
+		size_t packet_after(int64_t pos) const
+		{
+			const size_t k = packet_before(pos);
+			return (packet_pos(k) < pos) ? k + 1 : k;
+		}
+
+		/**
+		 * Returns the gain of the given sample, which mirrors the linear
+		 * crossfade applied by the player.
+		 */
+		float gain(size_t i) const
+		{
+			if (i < crossfade_in) {
+				return (i + 1.0f) / (crossfade_in + 1.0f);
+			}
+			if (i + crossfade_out >= length) {
+				const size_t j = i + crossfade_out - length;
+				return 1.0f - (j + 1.0f) / (crossfade_out + 1.0f);
+			}
+			return 1.0f;
+		}
+	};
+
+	std::vector<Chunk> chunks;
+
+	/**
+	 * Number of channels of the stitched stream, i.e. the maximum number of
+	 * channels of the chunks. Mono chunks in a stereo stream are upmixed.
+	 */
+	size_t channels = 0;
+
+	/**
+	 * Packet statistics of the last call to stitch().
+	 */
+	size_t n_copied = 0;
+	size_t n_encoded = 0;
+
+	/**
+	 * Muxer the stitched stream is written to. The last packet is held back
+	 * until the next packet arrives, since it must be flagged when the
+	 * stream ends.
+	 */
+	std::unique_ptr<OggOpusMuxer> muxer;
+	std::vector<uint8_t> pending;
+	bool has_pending = false;
+	int64_t granule = 0;
+
+	/**
+	 * Decodes the stitched and crossfaded audio starting at the given
+	 * position.
+	 */
+	void render(int64_t pos, float *tar, size_t n)
+	{
+		std::fill(tar, tar + n * channels, 0.0f);
+		std::vector<float> buf;
+		for (Chunk &chunk : chunks) {
+			const int64_t start = std::max(pos, chunk.offs);
+			const int64_t end =
+			    std::min(pos + int64_t(n), chunk.offs + int64_t(chunk.length));
+			if (start >= end) {
+				continue;
+			}
+			const size_t i0 = start - chunk.offs;
+			const size_t chunk_channels = chunk.index->channels();
+			buf.resize((end - start) * chunk_channels);
+			chunk.reader->seek(i0);
+			const size_t n_read = chunk.reader->read(buf.data(), end - start);
+			float *t = tar + (start - pos) * channels;
+			for (size_t i = 0; i < n_read; i++) {
+				const float g = chunk.gain(i0 + i);
+				for (size_t c = 0; c < channels; c++) {
+					const size_t c_src = (chunk_channels == channels) ? c : 0;
+					t[i * channels + c] +=
+					    g * buf[i * chunk_channels + c_src];
+				}
+			}
+		}
+	}
+
+	/**
+	 * Passes a packet to the muxer, holding it back until the next packet
+	 * arrives.
+	 */
+	void emit(const uint8_t *data, size_t size, size_t duration)
+	{
+		if (has_pending) {
+			muxer->write_frame(false, granule, pending.data(), pending.size());
+		}
+		pending.assign(data, data + size);
+		has_pending = true;
+		granule += duration;
+	}
+
+	/**
+	 * Copies the packets [k0, k1) of the given chunk.
+	 */
+	void copy(const Chunk &chunk, size_t k0, size_t k1)
+	{
+		for (size_t k = k0; k < k1; k++) {
+			const OggOpusIndex::Packet p = chunk.index->packet(k);
+			emit(p.data, p.size, p.duration);
+			n_copied++;
+		}
+	}
+
+	/**
+	 * Encodes the n samples starting at offs in the given buffer using frames
+	 * of size fs and passes the packets to the muxer. The buffer must contain
+	 * FRAME_SIZE samples before offs and 2 * FRAME_SIZE plus the encoder
+	 * lookahead samples after offs + n.
+	 */
+	void encode_frames(const std::vector<float> &buf, size_t offs, size_t n,
+	                   size_t fs, size_t bitrate)
+	{
+		Encoder::Settings settings;
+		settings.channels(channels).frame_duration(fs / 48.0f).headers(false);
+		const size_t lookahead = Encoder::lookahead(settings);
+
+		// The decoder output lags behind the encoder input by the encoder
+		// lookahead, and the delay buffer of a fresh encoder is zeroed. The
+		// input thus starts with enough frames preceding the samples to
+		// absorb the zeroed lookahead; the first of these frames is the
+		// lead-in frame. The packets of these frames are discarded. The input
+		// is shifted such that the remaining packets decode to exactly the
+		// requested samples.
+		const size_t n_drop = (lookahead + fs - 1) / fs;
+		std::stringstream ss;
+		{
+			Encoder enc(ss, Encoder::Tags(), 0, settings);
+			const float *src =
+			    buf.data() + (offs + lookahead - n_drop * fs) * channels;
+			enc.pre_roll(src, fs);
+			enc.encode(src + fs * channels, n + n_drop * fs, bitrate);
+		}
+
+		// Skip the leading packets, copy the packets covering the samples
+		const std::string data = ss.str();
+		OggOpusDemuxer demuxer(reinterpret_cast<const uint8_t *>(data.data()),
+		                       data.size());
+		OggOpusDemuxer::Packet packet;
+		for (size_t i = 0; i < n_drop; i++) {
+			if (!demuxer.next(packet)) {
+				throw ChunkStitcherError("Encoder produced no output");
+			}
+		}
+		for (size_t i = 0; i < n; i += fs) {
+			if (!demuxer.next(packet)) {
+				throw ChunkStitcherError("Encoder produced no output");
+			}
+			emit(packet.data, packet.size, fs);
+			n_encoded++;
+		}
+	}
+
+	/**
+	 * Re-encodes the audio between the positions t0 and t1. Unless this is
+	 * the final seam, the re-encoded packets exactly fill this range such that
+	 * the packets following the seam can be copied; the range must be a
+	 * multiple of MIN_FRAME_SIZE for this purpose. The final seam is trimmed
+	 * by the granule position of the last page instead.
+	 */
+	void encode(int64_t t0, int64_t t1, bool final, size_t bitrate)
+	{
+		const size_t n = t1 - t0;
+		if (!final && n % MIN_FRAME_SIZE != 0) {
+			throw ChunkStitcherError("Seam is not aligned to Opus frames");
+		}
+
+		// Decode the seam along with one frame before it and some extra
+		// samples after it, which cover the lead-in frame and the encoder
+		// lookahead
+		const size_t n_pre = FRAME_SIZE;
+		const size_t n_post = 3 * FRAME_SIZE;
+		std::vector<float> seam((n_pre + n + n_post) * channels);
+		render(t0 - int64_t(n_pre), seam.data(), n_pre + n + n_post);
+
+		// Encode the bulk of the seam with full frames and the remainder with
+		// short frames. The final seam is padded to full frames instead.
+		if (final) {
+			encode_frames(seam, n_pre, n, FRAME_SIZE, bitrate);
+			return;
+		}
+		const size_t n_full = (n / FRAME_SIZE) * FRAME_SIZE;
+		if (n_full > 0) {
+			encode_frames(seam, n_pre, n_full, FRAME_SIZE, bitrate);
+		}
+		if (n > n_full) {
+			encode_frames(seam, n_pre + n_full, n - n_full, MIN_FRAME_SIZE,
+			              bitrate);
+		}
+	}
+
+	void push_back(const uint8_t *data, size_t size)
+	{
+		const ChunkInfo info = validate_chunk(data, size);
+		if (!info.has_headers) {
+			throw ChunkStitcherError("Header-less chunks are not supported");
+		}
+
+		Chunk chunk;
+		chunk.index = std::make_shared<OggOpusIndex>(data, size);
+		chunk.reader.reset(new OpusReader(chunk.index));
+		const OggOpusIndex &index = *chunk.index;
+		const size_t mul = 48000 / index.rate();
+		chunk.length = index.length();
+		chunk.crossfade_in = info.crossfade_in * mul;
+		chunk.crossfade_out = info.crossfade_out * mul;
+
+		size_t n_bytes = 0, n_samples = 0;
+		for (size_t k = 0; k < index.size(); k++) {
+			n_bytes += index.packet(k).size;
+			n_samples += index.packet(k).duration;
+		}
+		chunk.bitrate = (n_bytes * 8 * 48000) / std::max<size_t>(n_samples, 1);
+
+		// Place the chunk such that its lead-in overlaps with the lead-out
+		// of the previous chunk
+		chunk.offs = 0;
+		if (!chunks.empty()) {
+			const Chunk &prev = chunks.back();
+			const OggOpusIndex &prev_index = *prev.index;
+			const bool same_mapping =
+			    index.channels() == prev_index.channels() &&
+			    index.mapping().family == prev_index.mapping().family &&
+			    index.mapping().streams == prev_index.mapping().streams &&
+			    index.mapping().coupled_streams ==
+			        prev_index.mapping().coupled_streams &&
+			    index.mapping().mapping == prev_index.mapping().mapping;
+
+			// Mono and stereo chunks (mapping family 0) may be mixed, e.g.
+			// dual-mono chunks encoded as mono. A stereo decoder decodes the
+			// mono packets as well.
+			const bool mono_stereo = index.mapping().family == 0 &&
+			                         prev_index.mapping().family == 0;
+			if (index.rate() != prev_index.rate() ||
+			    !(same_mapping || mono_stereo)) {
+				throw ChunkStitcherError(
+				    "Chunks must have the same sample rate and channels");
+			}
+			if (chunk.crossfade_in != prev.crossfade_out) {
+				throw ChunkStitcherError(
+				    "Crossfade does not match the previous chunk");
+			}
+			chunk.offs =
+			    prev.offs + int64_t(prev.length) - int64_t(prev.crossfade_out);
+
+			// The seams between the chunks are re-encoded with an integer
+			// number of Opus frames. This requires the packet boundaries of
+			// both chunks to be aligned to the smallest Opus frame size.
+			const int64_t shift =
+			    (chunk.offs - int64_t(index.pre_skip())) -
+			    (prev.offs - int64_t(prev_index.pre_skip()));
+			if (shift % int64_t(MIN_FRAME_SIZE) != 0) {
+				throw ChunkStitcherError(
+				    "Packets are not aligned to the previous chunk");
+			}
+		}
+		chunks.emplace_back(std::move(chunk));
+	}
+
+	void stitch(std::ostream &os)
+	{
+		if (chunks.empty()) {
+			throw ChunkStitcherError("No chunks to stitch");
+		}
+
+		// The stitched stream uses the channel mapping of the chunk with the
+		// most channels. Re-encoded packets must be decodable with the
+		// channel mapping of the copied packets.
+		const OggOpusIndex &first = *chunks[0].index;
+		const OggOpusIndex &ref =
+		    *std::max_element(chunks.begin(), chunks.end(),
+		                      [](const Chunk &a, const Chunk &b) {
+			                      return a.index->channels() <
+			                             b.index->channels();
+		                      })
+		         ->index;
+		channels = ref.channels();
+		if (chunks.size() > 1) {
+			const OggOpusMuxer::ChannelMapping mapping =
+			    Encoder::channel_mapping(
+			        Encoder::Settings().channels(channels));
+			if (mapping.family != ref.mapping().family ||
+			    mapping.streams != ref.mapping().streams ||
+			    mapping.coupled_streams != ref.mapping().coupled_streams ||
+			    mapping.mapping != ref.mapping().mapping) {
+				throw ChunkStitcherError("Unsupported channel mapping");
+			}
+		}
+
+		// Reset the output state. Positions are shifted by the pre_skip of
+		// the first chunk, whose lead-in is copied verbatim.
+		n_copied = n_encoded = 0;
+		granule = 0;
+		has_pending = false;
+		muxer.reset(new OggOpusMuxer(os, first.pre_skip(), first.vendor(),
+		                             OggOpusMuxer::Tags(), channels,
+		                             first.rate(), true, 0, ref.mapping()));
+		const int64_t pre_skip = first.pre_skip();
+		const Chunk &last = chunks.back();
+		const int64_t end = last.offs + int64_t(last.length);
+
+		size_t j = 0, k = 0;
+		while (true) {
+			// Copy all remaining packets of the last chunk
+			Chunk &chunk = chunks[j];
+			if (j + 1 == chunks.size()) {
+				copy(chunk, k, chunk.index->size());
+				break;
+			}
+
+			// Copy the packets up to the seam with the next chunk
+			const Chunk &next = chunks[j + 1];
+			const size_t k0 = std::max(
+			    k, chunk.packet_before(next.offs - int64_t(SEAM_MARGIN)));
+			copy(chunk, k, k0);
+			const int64_t t0 = chunk.packet_pos(k0);
+
+			// Find the end of the seam in the next chunk. Merge seams if the
+			// chunk is too short to contain the end of the seam before the
+			// following crossfade begins.
+			size_t e = j + 1;
+			size_t k1 = next.packet_after(next.offs +
+			                              int64_t(next.crossfade_in) +
+			                              int64_t(SEAM_MARGIN));
+			bool final = false;
+			while (true) {
+				const Chunk &c = chunks[e];
+				const bool is_last = (e + 1 == chunks.size());
+				if (is_last &&
+				    (k1 >= c.index->size() || c.packet_pos(k1) >= end)) {
+					final = true;
+					break;
+				}
+				if (!is_last && c.packet_pos(k1) >
+				                 chunks[e + 1].offs - int64_t(SEAM_MARGIN)) {
+					e++;
+					k1 = chunks[e].packet_after(chunks[e].offs +
+					                            int64_t(chunks[e].crossfade_in) +
+					                            int64_t(SEAM_MARGIN));
+					continue;
+				}
+				break;
+			}
+
+			// Re-encode the seam, continue copying after the seam
+			const size_t bitrate = std::max(chunk.bitrate, chunks[e].bitrate);
+			if (final) {
+				encode(t0, end, true, bitrate);
+				break;
+			}
+			encode(t0, chunks[e].packet_pos(k1), false, bitrate);
+			j = e;
+			k = k1;
+		}
+
+		// Flush the last packet, the granule position of the last page
+		// trims the stream to its length
+		const int64_t end_granule =
+		    std::min(granule, std::max<int64_t>(end + pre_skip, 0));
+		if (has_pending) {
+			muxer->write_frame(true, end_granule, pending.data(),
+			                   pending.size());
+		}
+		muxer.reset();
+		has_pending = false;
+	}
+};
+
+constexpr size_t ChunkStitcher::Impl::FRAME_SIZE;
+constexpr size_t ChunkStitcher::Impl::MIN_FRAME_SIZE;
+
+/******************************************************************************
+ * Class ChunkStitcher                                                        *
+ ******************************************************************************/
+
+constexpr size_t ChunkStitcher::SEAM_MARGIN;
+
+ChunkStitcher::ChunkStitcher() : m_impl(new Impl()) {}
+
+ChunkStitcher::~ChunkStitcher()
+{
+	// Implicitly destroy m_impl
+}
+
+void ChunkStitcher::push_back(const uint8_t *data, size_t size)
+{
+	m_impl->push_back(data, size);
+}
+
+size_t ChunkStitcher::size() const { return m_impl->chunks.size(); }
+
+void ChunkStitcher::stitch(std::ostream &os) { m_impl->stitch(os); }
+
+size_t ChunkStitcher::copied_packets() const { return m_impl->n_copied; }
+
+size_t ChunkStitcher::encoded_packets() const { return m_impl->n_encoded; }
+}
+}
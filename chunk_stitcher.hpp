@@ -0,0 +1,117 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file chunk_stitcher.hpp
+ *
+ * Declares the ChunkStitcher class which joins a sequence of chunks into a
+ * single continuous Ogg/Opus stream.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+
+namespace eolian {
+namespace stream {
+/**
+ * The ChunkStitcher class joins consecutive chunks written by the
+ * ChunkTranscoder or the ChunkRemuxer into a single Ogg/Opus stream with
+ * continuous granule positions, e.g. to offer a track for download without
+ * encoding it a second time. The Opus packets of the chunks are copied
+ * verbatim. Only the seams are re-encoded: the region around each crossfade,
+ * extended by SEAM_MARGIN samples on both sides and rounded to the packet
+ * boundaries of the adjacent chunks, is decoded, crossfaded in the same way
+ * as in the player and encoded again. Mono chunks, e.g. dual-mono chunks
+ * the ChunkTranscoder encoded as mono, may be part of a stereo stream; they
+ * are upmixed when decoding the seams.
+ *
+ * Seams are encoded with 20 ms frames followed by up to seven 2.5 ms frames.
+ * The packet boundaries of adjacent chunks must therefore be aligned to
+ * multiples of 2.5 ms (120 samples), which is the case if the chunk offsets
+ * are multiples of 120 samples and all chunks share the same pre_skip. This
+ * holds for the default ChunkTranscoder layouts, but not for chunk
+ * boundaries placed by ChunkTranscoder::Settings::search(). Chunks written by
+ * the ChunkRemuxer are always aligned. Positions are measured at 48000
+ * samples/s, the time basis of the Ogg/Opus granules.
+ */
+class ChunkStitcher {
+private:
+	/**
+	 * Actual implementation of the ChunkStitcher class.
+	 */
+	struct Impl;
+	std::unique_ptr<Impl> m_impl;
+
+public:
+	/**
+	 * Number of samples (20 ms) by which each seam is extended beyond the
+	 * crossfade. Hides the artifacts caused by switching between the decoder
+	 * states of the original and the re-encoded packets.
+	 */
+	static constexpr size_t SEAM_MARGIN = 960;
+
+	/**
+	 * Creates an empty ChunkStitcher instance.
+	 */
+	ChunkStitcher();
+
+	/**
+	 * Destroys the ChunkStitcher instance.
+	 */
+	~ChunkStitcher();
+
+	/**
+	 * Appends the given chunk. Throws an exception if the chunk is malformed,
+	 * is a header-less chunk, does not match the previous chunks or its
+	 * packets are not aligned to those of the previous chunk.
+	 *
+	 * @param data is a pointer at the chunk including its headers. The
+	 * packets are copied, so the buffer does not need to outlive the
+	 * ChunkStitcher instance.
+	 * @param size is the size of the chunk in bytes.
+	 */
+	void push_back(const uint8_t *data, size_t size);
+
+	/**
+	 * Returns the number of chunks that have been appended.
+	 */
+	size_t size() const;
+
+	/**
+	 * Writes the stitched Ogg/Opus stream to the given output stream. Throws
+	 * an exception if no chunk has been appended.
+	 *
+	 * @param os is the output stream the Ogg/Opus stream should be written to.
+	 */
+	void stitch(std::ostream &os);
+
+	/**
+	 * Returns the number of packets copied from the chunks and the number of
+	 * packets re-encoded by the last call to stitch().
+	 */
+	size_t copied_packets() const;
+	size_t encoded_packets() const;
+};
+}
+}
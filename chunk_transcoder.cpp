@@ -16,15 +16,49 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "bandwidth_detector.hpp"
+#include "chunk_planner.hpp"
 #include "chunk_transcoder.hpp"
+#include "complexity_controller.hpp"
+#include "decoder.hpp"
 #include "encoder.hpp"
+#include "ogg_opus_demuxer.hpp"
+#include "quality.hpp"
+#include "resampler.hpp"
+#include "signal_classifier.hpp"
+#include "silence.hpp"
+#include "stereo.hpp"
 
 namespace eolian {
 namespace stream {
+/**
+ * Updates the given 64-bit FNV-1a hash with the given data.
+ */
+static uint64_t fnv1a(const void *data, size_t size,
+                      uint64_t hash = 0xcbf29ce484222325ULL)
+{
+	const uint8_t *d = reinterpret_cast<const uint8_t *>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ d[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
 /******************************************************************************
  * Class ChunkTranscoder::Impl                                                *
  ******************************************************************************/
@@ -33,11 +67,33 @@ namespace stream {
  * Actual implementation of the ChunkTranscoder class.
  */
 struct ChunkTranscoder::Impl {
+	/**
+	 * Resolution of the bitrate search in bits per second.
+	 */
+	static constexpr size_t BITRATE_RESOLUTION = 4000;
+
+	/**
+	 * Number of digits comment header values are padded to in the
+	 * constant-size mode.
+	 */
+	static constexpr size_t TAG_VALUE_WIDTH = 10;
+
+	/**
+	 * Maximum number of encoded chunks kept in the deduplication cache.
+	 */
+	static constexpr size_t DEDUP_CACHE_SIZE = 64;
+
 	/**
 	 * Callback function used for reading RAW audio data from the decoder.
 	 */
 	DecoderCallback decoder;
 
+	/**
+	 * Converts the decoder output to the sample rate of the encoder if
+	 * Settings::input_rate() differs from Settings::rate().
+	 */
+	std::unique_ptr<Resampler> resampler;
+
 	/**
 	 * Current location within the stream. Offset after all the samples that
 	 * are currently in the sample buffer.
@@ -49,12 +105,24 @@ struct ChunkTranscoder::Impl {
 	 */
 	Settings settings;
 
+	/**
+	 * Computes the nominal position of each chunk from the settings.
+	 */
+	ChunkPlanner planner;
+
+	/**
+	 * Number of samples following a chunk that are read ahead and passed to
+	 * the encoder as post-roll. Zero if Settings::context() is false.
+	 */
+	size_t n_post_roll;
+
 	/**
 	 * Buffer holding enough samples for exactly one chunk, including the
 	 * overlaps. Such a large buffer is necessary since we don't know ahead of
 	 * time whether we're actually able to read the end overlap. Hence, the
 	 * entire buffer is sent to the encoder in a single pass, along with the
-	 * correct metadata.
+	 * correct metadata. Additionally, the buffer holds the boundary search
+	 * window and the post-roll samples following the chunk.
 	 */
 	std::vector<float> buf;
 
@@ -63,31 +131,222 @@ struct ChunkTranscoder::Impl {
 	 */
 	size_t buf_ptr = 0;
 
+	/**
+	 * Buffer holding the samples immediately preceding the sample buffer. These
+	 * are passed to the encoder as pre-roll.
+	 */
+	std::vector<float> pre_roll;
+
+	/**
+	 * Number of samples currently in the pre-roll buffer.
+	 */
+	size_t pre_roll_ptr = 0;
+
 	/**
 	 * Flag indicating whether the stream is currently at its end.
 	 */
 	bool at_end = false;
 
+	/**
+	 * Set to true if the start offset and index of the next block have been
+	 * determined while encoding the previous block. This is only the case if
+	 * the chunk boundaries are adapted to the signal.
+	 */
+	bool has_next_block = false;
+
+	/**
+	 * Start offset of the next block if has_next_block is true.
+	 */
+	size_t next_block_offs = 0;
+
+	/**
+	 * Index of the next block if has_next_block is true.
+	 */
+	size_t next_block_idx = 0;
+
+	/**
+	 * Metadata describing the last chunk that has been written.
+	 */
+	Chunk chunk;
+
+	/**
+	 * Controller adapting the encoder complexity to the target real-time
+	 * factor. Only used if Settings::target_rtf() is larger than zero.
+	 */
+	ComplexityController controller;
+
+	/**
+	 * Spectral analysis used to determine the bandwidth of each chunk if
+	 * Settings::auto_bandwidth() is true.
+	 */
+	BandwidthDetector bandwidth_detector;
+
+	/**
+	 * Maximum bandwidth passed to the encoder for the current chunk.
+	 */
+	Encoder::Bandwidth max_bandwidth;
+
+	/**
+	 * Speech/music classification of each chunk if Settings::auto_signal()
+	 * is true.
+	 */
+	SignalClassifier signal_classifier;
+
+	/**
+	 * Signal type hint passed to the encoder for the current chunk.
+	 */
+	Encoder::Signal signal;
+
+	/**
+	 * Number of channels the current chunk is encoded with. Differs from
+	 * Settings::channels() if a dual-mono chunk is encoded as mono.
+	 */
+	size_t chunk_channels;
+
+	/**
+	 * Downmixed sample and pre-roll buffers used if the current chunk is
+	 * encoded as mono.
+	 */
+	std::vector<float> mono_buf;
+	std::vector<float> mono_pre_roll;
+
+	/**
+	 * Parameters a silent chunk depends on: length, crossfades, bitrate,
+	 * number of channels, bandwidth and signal type.
+	 */
+	using SilenceKey = std::tuple<size_t, size_t, size_t, size_t, size_t,
+	                              Encoder::Bandwidth, Encoder::Signal>;
+
+	/**
+	 * Encoded data of the last silent chunk and the parameters it has been
+	 * encoded with. Silent chunks with the same parameters are copied from
+	 * this template.
+	 */
+	std::string silence_template;
+	SilenceKey silence_key;
+
+	/**
+	 * Encoded chunk stored in the deduplication cache along with the
+	 * metadata determined while encoding it. The encoder parameters and the
+	 * audio data the chunk has been encoded from are kept as well, so a hash
+	 * collision cannot produce a wrong chunk.
+	 */
+	struct DedupEntry {
+		std::string data;
+		size_t bitrate;
+		float snr;
+		std::string params;
+		std::vector<float> pre_roll;
+		std::vector<float> pcm;
+	};
+
+	/**
+	 * Recently encoded chunks indexed by chunk_hash() and the order in which
+	 * they have been inserted. Only used if Settings::dedup() is true.
+	 */
+	std::unordered_map<uint64_t, DedupEntry> dedup_cache;
+	std::deque<uint64_t> dedup_order;
+
+	/**
+	 * Encoder lookahead in samples. Only computed in the constant-size mode.
+	 */
+	size_t lookahead = 0;
+
+	/**
+	 * Size of the headers (or the descriptor in header-less mode) preceding
+	 * the audio pages of each chunk. Only computed in the constant-size mode.
+	 */
+	size_t header_size = 0;
+
 	Impl(DecoderCallback decoder, size_t decoder_offset,
 	     const Settings &settings)
 	    : decoder(decoder),
 	      offs(decoder_offset),
 	      settings(settings),
-	      buf(settings.total_length_samples() * settings.channels(), 0.0)
+	      planner(settings),
+	      n_post_roll(settings.context()
+	                      ? 2 * settings.frame_size()
+	                      : 0),
+	      buf((planner.max_length_samples() + 2 * settings.search_samples() +
+	           std::max(n_post_roll, settings.frame_size())) *
+	              settings.channels(),
+	          0.0),
+	      pre_roll(settings.context()
+	                   ? settings.frame_size() * settings.channels()
+	                   : 0,
+	               0.0),
+	      controller(settings),
+	      bandwidth_detector(settings.rate(), settings.channels(),
+	                         settings.frame_size()),
+	      max_bandwidth(settings.max_bandwidth()),
+	      signal_classifier(settings.rate(), settings.channels()),
+	      signal(settings.signal()),
+	      chunk_channels(settings.channels())
 	{
+		// Header-less chunks share the id header of the init segment, so the
+		// number of channels must not change between chunks
+		assert(!settings.headerless() ||
+		       settings.dual_mono_threshold() == 0.0f);
+
+		// Per-chunk bitrates are computed for the planned chunk boundaries
+		assert(settings.chunk_bitrates().empty() || settings.search() == 0.0f);
+
+		// In the constant-size mode, measure the size of the headers, which
+		// are the same for all chunks
+		if (settings.constant_size()) {
+			assert(settings.packet_frames() == 1);
+			assert(settings.channels() <= 2);
+			assert(!settings.per_chunk_bitrate());
+			lookahead = Encoder::lookahead(encoder_settings());
+			if (settings.headerless()) {
+				header_size = sizeof(Descriptor);
+			}
+			else {
+				std::stringstream ss;
+				Encoder::write_headers(ss, tags(0, 0, settings.bitrate()),
+				                       encoder_settings());
+				header_size = ss.str().size();
+			}
+		}
+
+		// Place a resampler between the decoder and the chunk buffer
+		if (settings.input_rate() != 0 &&
+		    settings.input_rate() != settings.rate()) {
+			assert((decoder_offset * settings.input_rate()) %
+			           settings.rate() ==
+			       0);
+			resampler.reset(new Resampler(decoder, settings.channels(),
+			                              settings.input_rate(),
+			                              settings.rate()));
+			Resampler *resampler_ptr = resampler.get();
+			this->decoder = [resampler_ptr](float *buf, size_t buf_size) {
+				return resampler_ptr->read(buf, buf_size);
+			};
+		}
 	}
 
 	Impl(std::istream &is, size_t decoder_offset, const Settings &settings)
-	    : Impl(DecoderCallback(), decoder_offset, settings)
-	{
-		std::istream *is_ptr = &is;
-		this->decoder = [is_ptr, this](float *buf,
-		                               size_t buf_size) mutable -> size_t {
-			const size_t bytes_per_sample =
-			    sizeof(float) * this->settings.channels();
-			is_ptr->read(reinterpret_cast<char *>(buf),
-			             buf_size * bytes_per_sample);
-			return is_ptr->gcount() / bytes_per_sample;
+	    : Impl(read_stream(is, settings), decoder_offset, settings)
+	{
+	}
+
+	/**
+	 * Returns a decoder callback reading RAW samples in the input format from
+	 * the given input stream and converting them to floating point.
+	 */
+	static DecoderCallback read_stream(std::istream &is,
+	                                   const Settings &settings)
+	{
+		assert(settings.input_channels() == 0 ||
+		       settings.input_channels() == settings.channels() ||
+		       settings.channels() == 1);
+		std::shared_ptr<SampleReader> reader = std::make_shared<SampleReader>(
+		    is, settings.input_format(),
+		    settings.input_channels() ? settings.input_channels()
+		                              : settings.channels(),
+		    settings.channels());
+		return [reader](float *buf, size_t buf_size) {
+			return reader->read(buf, buf_size);
 		};
 	}
 
@@ -100,93 +359,740 @@ struct ChunkTranscoder::Impl {
 		return std::max(0L, int64_t(offs) - int64_t(buf_ptr));
 	}
 
+	/**
+	 * Returns the settings passed to the Encoder.
+	 */
+	Encoder::Settings encoder_settings() const
+	{
+		return Encoder::Settings()
+		    .channels(chunk_channels)
+		    .rate(settings.rate())
+		    .headers(!settings.headerless())
+		    .packet_frames(settings.packet_frames())
+		    .frame_duration(settings.frame_duration())
+		    .complexity(settings.complexity())
+		    .vbr_mode(settings.constant_size() ? Encoder::VBRMode::CBR
+		                                       : settings.vbr_mode())
+		    .signal(signal)
+		    .max_bandwidth(max_bandwidth)
+		    .lsb_depth(settings.lsb_depth())
+		    .dtx(settings.dtx())
+		    .silence_threshold(settings.silence_threshold())
+		    .packet_size(settings.constant_size()
+		                     ? settings.constant_packet_size()
+		                     : 0)
+		    .packets_per_page(settings.constant_size()
+		                          ? settings.constant_packets_per_page()
+		                          : 0);
+	}
+
+	/**
+	 * Formats a value stored in the comment header. In the constant-size mode
+	 * values are zero-padded to a fixed width.
+	 */
+	std::string tag_value(size_t value) const
+	{
+		std::string res = std::to_string(value);
+		if (settings.constant_size() && res.size() < TAG_VALUE_WIDTH) {
+			res.insert(0, TAG_VALUE_WIDTH - res.size(), '0');
+		}
+		return res;
+	}
+
+	/**
+	 * Returns the comment header tags of a chunk with the given crossfades.
+	 */
+	Encoder::Tags tags(size_t crossfade_in, size_t crossfade_out,
+	                   size_t bitrate) const
+	{
+		Encoder::Tags res{{"CF_IN", tag_value(crossfade_in)},
+		                  {"CF_OUT", tag_value(crossfade_out)}};
+		if (settings.per_chunk_bitrate()) {
+			res.emplace_back("BITRATE", tag_value(bitrate));
+		}
+		return res;
+	}
+
+	/**
+	 * Computes the size of a chunk with the given length in the constant-size
+	 * mode. Mirrors the number of frames produced by the Encoder: one lead-in
+	 * frame, the full frames, and at least one padding frame; additional
+	 * padding frames are added until the encoder lookahead is covered.
+	 */
+	size_t chunk_size(size_t length) const
+	{
+		if (!settings.constant_size()) {
+			return 0;
+		}
+		const size_t fs = settings.frame_size();
+		const size_t rem = length % fs;
+		size_t n_packets = 1 + length / fs + 1;
+		if (lookahead > fs - rem) {
+			n_packets += (lookahead - (fs - rem) + fs - 1) / fs;
+		}
+
+		// Each page consists of a 27 byte header, the segment table and the
+		// packet data
+		const size_t packet_size = settings.constant_packet_size();
+		const size_t segments = packet_size / 255 + 1;
+		const size_t per_page = settings.constant_packets_per_page();
+		auto page_size = [&](size_t n) {
+			return (n == 0) ? 0 : 27 + n * (segments + packet_size);
+		};
+		return header_size + (n_packets / per_page) * page_size(per_page) +
+		       page_size(n_packets % per_page);
+	}
+
+	/**
+	 * Appends the given samples to the pre-roll buffer, only keeping the most
+	 * recent samples.
+	 */
+	void push_pre_roll(const float *src, size_t n_src)
+	{
+		const size_t channels = settings.channels();
+		const size_t cap = pre_roll.size() / channels;
+		const size_t n = std::min(n_src, cap);
+		const size_t n_keep = std::min(pre_roll_ptr, cap - n);
+		std::copy(pre_roll.data() + (pre_roll_ptr - n_keep) * channels,
+		          pre_roll.data() + pre_roll_ptr * channels, pre_roll.data());
+		std::copy(src + (n_src - n) * channels, src + n_src * channels,
+		          pre_roll.data() + n_keep * channels);
+		pre_roll_ptr = n_keep + n;
+	}
+
+	/**
+	 * Advances the read offset to the given stream offset. Samples before the
+	 * target offset are discarded (and moved to the pre-roll buffer). Returns
+	 * false if the stream ended before the target offset was reached.
+	 */
+	bool seek(size_t target)
+	{
+		const size_t channels = settings.channels();
+		if (target <= offs) {
+			const size_t n = std::min(target - read_offs(), buf_ptr);
+			push_pre_roll(buf.data(), n);
+			std::copy(buf.data() + n * channels,
+			          buf.data() + buf_ptr * channels, buf.data());
+			buf_ptr -= n;
+			return true;
+		}
+
+		// Discard all buffered data
+		push_pre_roll(buf.data(), buf_ptr);
+		buf_ptr = 0;
+		while (offs < target) {
+			const size_t n_read =
+			    std::min(target - offs, buf.size() / channels);
+			const size_t read = decoder(buf.data(), n_read);
+			offs += read;
+			push_pre_roll(buf.data(), read);
+			if (read < n_read) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Reads samples into the sample buffer until the given stream offset is
+	 * reached. Returns false if the stream ended before that.
+	 */
+	bool fill(size_t target)
+	{
+		const size_t channels = settings.channels();
+		if (target <= offs) {
+			return true;
+		}
+		const size_t n_read = target - offs;
+		assert(buf_ptr + n_read <= buf.size() / channels);
+		const size_t read = decoder(buf.data() + buf_ptr * channels, n_read);
+		offs += read;
+		buf_ptr += read;
+		return read == n_read;
+	}
+
+	/**
+	 * Number of samples around the crossfade region that are taken into
+	 * account when searching for a chunk boundary.
+	 */
+	size_t search_margin() const
+	{
+		return settings.frame_size() / 2;
+	}
+
+	/**
+	 * Searches the buffered stream offsets in the range [lo, hi] for the chunk
+	 * boundary with the lowest signal energy around the crossfade region. The
+	 * region is extended by half a frame on each side, since this is the
+	 * amount of data the lead-in and lead-out predictions are based on. The
+	 * buffer should contain search_margin() samples beyond hi. Ties
+	 * are resolved in favour of the offset closest to the nominal boundary.
+	 */
+	size_t find_boundary(size_t lo, size_t hi, size_t nominal) const
+	{
+		const size_t channels = settings.channels();
+		const size_t margin = search_margin();
+		const size_t before = settings.overlap_samples() + margin;
+		const size_t buf_offs = read_offs();
+
+		// Compute the cumulative energy of all buffered samples in the
+		// relevant region
+		const size_t i0 = std::max(lo, buf_offs + before) - before - buf_offs;
+		const size_t i1 = std::min(hi + margin, offs) - buf_offs;
+		std::vector<double> energy(i1 - i0 + 1, 0.0);
+		for (size_t i = i0; i < i1; i++) {
+			double e = 0.0;
+			for (size_t j = 0; j < channels; j++) {
+				const double x = buf[i * channels + j];
+				e += x * x;
+			}
+			energy[i - i0 + 1] = energy[i - i0] + e;
+		}
+
+		// Find the minimum energy window
+		size_t best = nominal;
+		double best_energy = std::numeric_limits<double>::max();
+		for (size_t b = lo; b <= hi; b++) {
+			const size_t w0 = std::max(b - buf_offs, i0 + before) - before;
+			const size_t w1 = std::min(b - buf_offs + margin, i1);
+			const double e = energy[w1 - i0] - energy[w0 - i0];
+			const size_t dist = (b > nominal) ? (b - nominal) : (nominal - b);
+			const size_t best_dist =
+			    (best > nominal) ? (best - nominal) : (nominal - best);
+			if (e < best_energy || (e == best_energy && dist < best_dist)) {
+				best = b;
+				best_energy = e;
+			}
+		}
+		return best;
+	}
+
+	/**
+	 * Returns the sample buffer holding the current chunk with
+	 * chunk_channels channels.
+	 */
+	const float *chunk_buf() const
+	{
+		return (chunk_channels == settings.channels()) ? buf.data()
+		                                               : mono_buf.data();
+	}
+
+	/**
+	 * Returns the pre-roll buffer with chunk_channels channels.
+	 */
+	const float *chunk_pre_roll() const
+	{
+		return (chunk_channels == settings.channels()) ? pre_roll.data()
+		                                               : mono_pre_roll.data();
+	}
+
+	/**
+	 * Wall-clock time in seconds and number of samples of an encoded frame.
+	 */
+	using FrameTiming = std::pair<double, size_t>;
+
+	/**
+	 * Encodes the first n samples in the sample buffer as a single Ogg/Opus
+	 * stream and writes it to the given output stream. Returns the number of
+	 * samples that must be discarded at the beginning of the decoded stream.
+	 * If timings is not null, the frame timings are stored there instead of
+	 * being passed to the complexity controller. This is used for trial
+	 * encodes, of which only the one that is actually written should
+	 * influence the controller.
+	 */
+	size_t encode_chunk(std::ostream &os, size_t n, size_t crossfade_in,
+	                    size_t crossfade_out, size_t bitrate,
+	                    std::vector<FrameTiming> *timings = nullptr)
+	{
+		const size_t channels = chunk_channels;
+		const float *src = chunk_buf();
+		const bool adaptive = settings.target_rtf() > 0.0f;
+		using clock = std::chrono::steady_clock;
+		clock::time_point t;
+		size_t n_last = 0, pre_skip = 0;
+		auto update = [&](double seconds, size_t n_frame) {
+			if (timings) {
+				timings->emplace_back(seconds, n_frame);
+			}
+			else {
+				controller.update(seconds, n_frame);
+			}
+		};
+		{
+			// Assemble the comment header. The bitrate is only recorded if it
+			// varies between the chunks.
+			Encoder enc(os,
+			            settings.headerless()
+			                ? Encoder::Tags()
+			                : tags(crossfade_in, crossfade_out, bitrate),
+			            0, encoder_settings());
+
+			// Pass the neighbouring audio data to the encoder. Note that both
+			// buffers are empty if Settings::context() is false.
+			enc.pre_roll(chunk_pre_roll(), pre_roll_ptr);
+			enc.post_roll(src + n * channels,
+			              std::min(buf_ptr - n, n_post_roll));
+
+			// If the adaptive complexity control is active, pass the data
+			// frame by frame to the encoder and measure the time it takes to
+			// encode each frame.
+			if (adaptive) {
+				const size_t fs = settings.frame_size();
+				for (size_t i = 0; i < n; i += fs) {
+					const size_t n_frame = std::min(fs, n - i);
+					t = clock::now();
+					enc.complexity(controller.complexity());
+					enc.encode(src + i * channels, n_frame, bitrate);
+					if (i + n_frame < n) {
+						update(
+						    std::chrono::duration<double>(clock::now() - t)
+						        .count(),
+						    n_frame);
+					}
+					else {
+						n_last = n_frame;
+					}
+				}
+				chunk.complexity = controller.complexity();
+			}
+			else {
+				enc.encode(src, n, bitrate);
+				chunk.complexity = settings.complexity();
+			}
+			pre_skip = enc.frame_size() + enc.pre_skip();
+		}
+
+		// The encoder encodes the lead-out and padding frames when it is
+		// destroyed. Account for them in the timing of the last frame.
+		if (n_last > 0) {
+			update(std::chrono::duration<double>(clock::now() - t).count(),
+			       n_last);
+		}
+		return pre_skip;
+	}
+
+	/**
+	 * Decodes the given Ogg/Opus stream and returns the segmental SNR with
+	 * respect to the first n samples in the sample buffer.
+	 */
+	float measure_snr(const std::string &data, size_t n, size_t pre_skip) const
+	{
+		const size_t channels = chunk_channels;
+		OggOpusDemuxer demuxer(reinterpret_cast<const uint8_t *>(data.data()),
+		                       data.size());
+		Decoder decoder(channels, settings.rate(),
+		                Encoder::channel_mapping(encoder_settings()));
+		std::vector<float> pcm(
+		    (pre_skip + n + Decoder::max_packet_samples(settings.rate())) *
+		        channels,
+		    0.0f);
+		size_t pcm_ptr = 0;
+		OggOpusDemuxer::Packet packet;
+		while (pcm_ptr < pre_skip + n && demuxer.next(packet)) {
+			pcm_ptr += decoder.decode(packet.data, packet.size,
+			                          pcm.data() + pcm_ptr * channels,
+			                          pcm.size() / channels - pcm_ptr);
+		}
+		return segmental_snr(chunk_buf(), pcm.data() + pre_skip * channels, n,
+		                     channels, settings.frame_size());
+	}
+
+	/**
+	 * Encodes the first n samples in the sample buffer with the lowest
+	 * bitrate between Settings::min_bitrate() and the given bitrate for
+	 * which the decoded audio reaches Settings::target_snr(). The bitrate is
+	 * determined using a binary search over trial encodes. Since each chunk
+	 * is an independent Opus stream, a trial is simply a complete encode of
+	 * the chunk into a temporary buffer. Only the timing of the trial that
+	 * is written to the output is passed to the complexity controller.
+	 */
+	void encode_chunk_for_quality(std::ostream &os, size_t n,
+	                              size_t crossfade_in, size_t crossfade_out,
+	                              size_t bitrate)
+	{
+		std::string best;
+		float best_snr = 0.0f;
+		std::vector<FrameTiming> best_timings;
+		auto trial = [&](size_t trial_bitrate) {
+			std::stringstream ss;
+			std::vector<FrameTiming> timings;
+			const size_t pre_skip = encode_chunk(
+			    ss, n, crossfade_in, crossfade_out, trial_bitrate, &timings);
+			const float snr = measure_snr(ss.str(), n, pre_skip);
+			const bool success = snr >= settings.target_snr();
+			if (success || best.empty()) {
+				best = ss.str();
+				best_snr = snr;
+				best_timings = std::move(timings);
+			}
+			return success;
+		};
+
+		// Try the maximum bitrate first. If it does not reach the target
+		// quality, there is no point in searching for a lower bitrate. If
+		// the minimum bitrate already reaches the target, use it directly.
+		// Otherwise search between the two, where lo always fails and hi
+		// always reaches the target.
+		size_t lo = std::min(settings.min_bitrate(), bitrate);
+		size_t hi = bitrate;
+		if (trial(hi) && lo < hi) {
+			if (trial(lo)) {
+				hi = lo;
+			}
+			while (hi - lo > BITRATE_RESOLUTION) {
+				const size_t mid = lo + (hi - lo) / 2;
+				if (trial(mid)) {
+					hi = mid;
+				}
+				else {
+					lo = mid;
+				}
+			}
+		}
+		for (const FrameTiming &timing : best_timings) {
+			controller.update(timing.first, timing.second);
+		}
+		os.write(best.data(), best.size());
+		chunk.bitrate = hi;
+		chunk.snr = best_snr;
+	}
+
+	/**
+	 * Encodes the first n samples in the sample buffer and writes the
+	 * resulting chunk to the given output stream. The chunk is encoded at
+	 * the given bitrate, at the lowest bitrate reaching the target quality,
+	 * or copied from the silence template.
+	 */
+	void encode_chunk_data(std::ostream &os, size_t n, size_t crossfade_in,
+	                       size_t crossfade_out, size_t bitrate)
+	{
+		if (settings.target_snr() > 0.0f) {
+			encode_chunk_for_quality(os, n, crossfade_in, crossfade_out,
+			                         bitrate);
+		}
+		else if (chunk.silent && settings.target_rtf() == 0.0f) {
+			// Silent chunks only depend on their length and the encoder
+			// parameters, copy them from the template if possible
+			const SilenceKey key(n, crossfade_in, crossfade_out, bitrate,
+			                     chunk_channels, max_bandwidth, signal);
+			if (silence_template.empty() || key != silence_key) {
+				std::stringstream ss;
+				encode_chunk(ss, n, crossfade_in, crossfade_out, bitrate);
+				silence_template = ss.str();
+				silence_key = key;
+			}
+			write_chunk(os, silence_template, n);
+			chunk.complexity = settings.complexity();
+			chunk.bitrate = bitrate;
+		}
+		else if (settings.constant_size()) {
+			std::stringstream ss;
+			encode_chunk(ss, n, crossfade_in, crossfade_out, bitrate);
+			write_chunk(os, ss.str(), n);
+			chunk.bitrate = bitrate;
+		}
+		else {
+			encode_chunk(os, n, crossfade_in, crossfade_out, bitrate);
+			chunk.bitrate = bitrate;
+		}
+	}
+
+	/**
+	 * Returns a string describing all parameters a chunk with n samples
+	 * depends on, apart from the audio data.
+	 */
+	std::string chunk_params(size_t n, size_t crossfade_in,
+	                         size_t crossfade_out, size_t bitrate) const
+	{
+		const Encoder::Settings es = encoder_settings();
+		std::stringstream ss;
+		ss << es.channels() << ' ' << es.rate() << ' ' << es.headers() << ' '
+		   << es.packet_frames() << ' ' << es.frame_duration() << ' '
+		   << es.complexity() << ' ' << int(es.vbr_mode()) << ' '
+		   << int(es.signal()) << ' ' << int(es.max_bandwidth()) << ' '
+		   << es.lsb_depth() << ' ' << es.packet_size() << ' '
+		   << es.packets_per_page() << ' ' << es.dtx() << ' '
+		   << es.silence_threshold() << ' ' << settings.target_snr() << ' '
+		   << settings.min_bitrate() << ' ' << n << ' ' << crossfade_in << ' '
+		   << crossfade_out << ' ' << bitrate;
+		return ss.str();
+	}
+
+	/**
+	 * Computes a hash over the given chunk parameters and the audio data
+	 * passed to the encoder, i.e. the pre-roll and the first n_pcm samples
+	 * in the sample buffer.
+	 */
+	uint64_t chunk_hash(const std::string &params, size_t n_pcm) const
+	{
+		const size_t channels = settings.channels();
+		uint64_t hash = fnv1a(params.data(), params.size());
+		hash = fnv1a(pre_roll.data(), pre_roll_ptr * channels * sizeof(float),
+		             hash);
+		return fnv1a(buf.data(), n_pcm * channels * sizeof(float), hash);
+	}
+
+	/**
+	 * Returns true if the given deduplication cache entry has been encoded
+	 * with the given parameters from the same audio data as the current
+	 * chunk.
+	 */
+	bool dedup_matches(const DedupEntry &entry, const std::string &params,
+	                   size_t n_pcm) const
+	{
+		const size_t channels = settings.channels();
+		return entry.params == params &&
+		       entry.pre_roll.size() == pre_roll_ptr * channels &&
+		       entry.pcm.size() == n_pcm * channels &&
+		       memcmp(entry.pre_roll.data(), pre_roll.data(),
+		              entry.pre_roll.size() * sizeof(float)) == 0 &&
+		       memcmp(entry.pcm.data(), buf.data(),
+		              entry.pcm.size() * sizeof(float)) == 0;
+	}
+
+	/**
+	 * Writes the encoded data of a chunk with the given length to the output
+	 * stream. In the constant-size mode, verifies that the chunk has the
+	 * expected size first.
+	 */
+	void write_chunk(std::ostream &os, const std::string &data, size_t n) const
+	{
+		if (settings.constant_size()) {
+			const size_t descr_size =
+			    settings.headerless() ? sizeof(Descriptor) : 0;
+			if (descr_size + data.size() != chunk_size(n)) {
+				throw std::runtime_error(
+				    "Chunk size does not match the constant-size layout");
+			}
+		}
+		os.write(data.data(), data.size());
+	}
+
 	bool transcode(std::ostream &os)
 	{
 		// If we've already reached the end, abort
 		if (at_end) {
 			return false;
 		}
+		const std::streampos os_start = os.tellp();
 
-		// If the decoder is currently at an offset that is smaller than the
-		// start offset of the next block, advance to the actual start offset.
+		// Determine the start offset of the next block. If the boundaries are
+		// adapted to the signal, the start offset has either been determined
+		// while encoding the previous block, or must be searched for now.
+		const size_t overlap = settings.overlap_samples();
+		const size_t search = settings.search_samples();
 		const size_t next_idx = idx();
-		const size_t next_idx_offs =
-		    settings.offs_for_block_idx_samples(next_idx);
-		while (offs < next_idx_offs) {
-			const size_t n_read = std::min(next_idx_offs - offs,
-			                               buf.size() / settings.channels());
-			const size_t read = decoder(buf.data(), n_read);
-			offs += read;
-			if (read < n_read) {
+		size_t next_idx_offs = planner.offs_for_block_idx_samples(next_idx);
+		if (has_next_block) {
+			next_idx_offs = next_block_offs;
+		}
+		else if (search > 0 && next_idx > 0) {
+			// The energy windows of the earliest candidates extend
+			// overlap + search_margin() samples before the search window
+			const size_t nominal = next_idx_offs + overlap;
+			const size_t search_start = std::max<int64_t>(
+			    read_offs(), int64_t(nominal) - int64_t(search + overlap +
+			                                            search_margin()));
+			if (!seek(search_start) || !fill(nominal + search)) {
 				at_end = true;
 				return false;
 			}
+			fill(nominal + search + search_margin());
+			next_idx_offs =
+			    find_boundary(std::max(read_offs() + overlap, nominal - search),
+			                  nominal + search, nominal) -
+			    overlap;
+		}
 
-			// Discard all buffered data
-			buf_ptr = 0;
+		// If the decoder is currently at an offset that is smaller than the
+		// start offset of the next block, advance to the actual start offset.
+		if (!seek(next_idx_offs)) {
+			at_end = true;
+			return false;
 		}
 
 		// We should now be at the exact location we need to be at
 		assert(read_offs() == next_idx_offs);
 
-		// Read all remaining data, assemble the crossfade metadata
-		size_t crossfade_in =
-		    (next_idx_offs == 0) ? 0 : settings.overlap_samples();
-		size_t crossfade_out = settings.overlap_samples();
-		const size_t offs_end =
-		    settings.offs_end_for_block_idx_samples(next_idx);
-		const size_t n_read = offs_end - offs;
-		const size_t read =
-		    decoder(buf.data() + buf_ptr * settings.channels(), n_read);
-		if (read < n_read) {
+		// Read all remaining data including the search window and the
+		// post-roll, assemble the crossfade metadata
+		size_t crossfade_in = (next_idx_offs == 0) ? 0 : overlap;
+		size_t crossfade_out = overlap;
+		const size_t nominal_end =
+		    planner.offs_end_for_block_idx_samples(next_idx);
+		fill(nominal_end + search +
+		     std::max(n_post_roll, search > 0 ? search_margin() : 0));
+
+		// Determine the actual end of the block. If the stream ends before the
+		// nominal end (or within the search window) this is the last block.
+		size_t offs_end = nominal_end;
+		if (offs < nominal_end || (search > 0 && offs < nominal_end + search)) {
+			offs_end = offs;
 			crossfade_out = 0;
 			at_end = true;
 		}
-		offs += read;
+		else if (search > 0) {
+			offs_end = find_boundary(
+			    std::max(nominal_end - search, next_idx_offs + 2 * overlap),
+			    nominal_end + search, nominal_end);
+		}
 
 		// Encode the data as Ogg/Opus and write it to the output stream
-		const size_t chunk_size_total = buf_ptr + read;
+		const size_t chunk_size_total = offs_end - next_idx_offs;
 		if (chunk_size_total == 0) {
 			return false;
 		}
-		{
-			Encoder enc(os,
-			            {{"CF_IN", std::to_string(crossfade_in)},
-			             {"CF_OUT", std::to_string(crossfade_out)}},
-			            0, settings.channels(), settings.rate());
 
-			enc.encode(buf.data(), chunk_size_total, settings.bitrate());
+		// In header-less mode, prefix the chunk with a binary descriptor
+		// instead of writing the crossfade metadata to the comment header.
+		// The fields are serialised in little endian independent of the host.
+		if (settings.headerless()) {
+			const Descriptor descr;
+			uint8_t data[sizeof(Descriptor)];
+			uint8_t *p = std::copy(std::begin(descr.magic),
+			                       std::end(descr.magic), data);
+			*(p++) = descr.version;
+			for (const uint32_t value : {uint32_t(crossfade_in),
+			                             uint32_t(crossfade_out)}) {
+				for (size_t i = 0; i < 4; i++) {
+					*(p++) = (value >> (8 * i)) & 0xFF;
+				}
+			}
+			os.write(reinterpret_cast<const char *>(data), sizeof(data));
+		}
+
+		// Limit the encoder bandwidth to the bandwidth of the signal
+		using clock = std::chrono::steady_clock;
+		const clock::time_point t0 = clock::now();
+		max_bandwidth = settings.max_bandwidth();
+		if (settings.auto_bandwidth()) {
+			bandwidth_detector.reset();
+			bandwidth_detector.analyse(buf.data(), chunk_size_total);
+			max_bandwidth = std::min(max_bandwidth,
+			                         bandwidth_detector.bandwidth());
 		}
+		chunk.bandwidth = max_bandwidth;
 
-		// Keep the last crossfade_out samples in the buffer, adjust the buf_ptr
-		// accordingly
-		float *crossfade_end =
-		    buf.data() + chunk_size_total * settings.channels();
-		float *crossfade_start =
-		    crossfade_end - crossfade_out * settings.channels();
-		std::copy(crossfade_start, crossfade_end, buf.data());
-		buf_ptr = crossfade_out;
+		// Classify the chunk as speech or music and limit the bitrate of
+		// speech chunks
+		size_t bitrate = settings.bitrate_for_chunk(next_idx);
+		signal = settings.signal();
+		if (settings.auto_signal()) {
+			signal_classifier.reset();
+			signal_classifier.analyse(buf.data(), chunk_size_total);
+			signal = signal_classifier.signal();
+			if (signal == Encoder::Signal::VOICE) {
+				bitrate = std::min(bitrate, settings.speech_bitrate());
+			}
+		}
+		chunk.signal = signal;
+
+		// Encode dual-mono chunks as mono. The mono signal of the chunk and
+		// the surrounding audio data is assembled in separate buffers.
+		const size_t channels = settings.channels();
+		const size_t n_post = std::min(buf_ptr - chunk_size_total, n_post_roll);
+		chunk_channels = channels;
+		if (channels == 2 && settings.dual_mono_threshold() > 0.0f &&
+		    side_ratio(buf.data(), chunk_size_total) <
+		        settings.dual_mono_threshold()) {
+			chunk_channels = 1;
+			bitrate /= 2;
+			mono_buf.resize(chunk_size_total + n_post);
+			mono_pre_roll.resize(pre_roll_ptr);
+			downmix(buf.data(), mono_buf.data(), chunk_size_total + n_post);
+			downmix(pre_roll.data(), mono_pre_roll.data(), pre_roll_ptr);
+		}
+		chunk.channels = chunk_channels;
+
+		// Check whether the chunk and the surrounding audio data passed to
+		// the encoder are silent
+		chunk.silent =
+		    is_silent(buf.data(), (chunk_size_total + n_post) * channels,
+		              settings.silence_threshold()) &&
+		    is_silent(pre_roll.data(), pre_roll_ptr * channels,
+		              settings.silence_threshold());
+
+		// Encode the chunk. If the same audio data has been encoded with the
+		// same parameters before, reuse the encoded chunk.
+		if (settings.dedup() && settings.target_rtf() == 0.0f) {
+			const size_t n_pcm = chunk_size_total + n_post;
+			const std::string params = chunk_params(
+			    chunk_size_total, crossfade_in, crossfade_out, bitrate);
+			const uint64_t hash = chunk_hash(params, n_pcm);
+			auto it = dedup_cache.find(hash);
+			const bool hit = it != dedup_cache.end();
+			chunk.duplicate = hit && dedup_matches(it->second, params, n_pcm);
+			if (chunk.duplicate) {
+				chunk.bitrate = it->second.bitrate;
+				chunk.snr = it->second.snr;
+				chunk.complexity = settings.complexity();
+				os.write(it->second.data.data(), it->second.data.size());
+			}
+			else if (hit) {
+				// Hash collision, encode the chunk without caching it
+				encode_chunk_data(os, chunk_size_total, crossfade_in,
+				                  crossfade_out, bitrate);
+			}
+			else {
+				std::stringstream ss;
+				encode_chunk_data(ss, chunk_size_total, crossfade_in,
+				                  crossfade_out, bitrate);
+				if (dedup_order.size() >= DEDUP_CACHE_SIZE) {
+					dedup_cache.erase(dedup_order.front());
+					dedup_order.pop_front();
+				}
+				const std::string data = ss.str();
+				dedup_cache.emplace(
+				    hash,
+				    DedupEntry{data, chunk.bitrate, chunk.snr, params,
+				               std::vector<float>(pre_roll.begin(),
+				                                  pre_roll.begin() +
+				                                      pre_roll_ptr * channels),
+				               std::vector<float>(buf.begin(),
+				                                  buf.begin() + n_pcm * channels)});
+				dedup_order.push_back(hash);
+				os.write(data.data(), data.size());
+			}
+		}
+		else {
+			encode_chunk_data(os, chunk_size_total, crossfade_in, crossfade_out,
+			                  bitrate);
+		}
+		chunk.size = (os_start < 0) ? 0 : size_t(os.tellp() - os_start);
+		const double t_total =
+		    std::chrono::duration<double>(clock::now() - t0).count();
+		chunk.rtf = t_total * settings.rate() / chunk_size_total;
+
+		// Remember the chunk metadata
+		chunk.idx = next_idx;
+		chunk.offs = next_idx_offs;
+		chunk.length = chunk_size_total;
+		chunk.crossfade_in = crossfade_in;
+		chunk.crossfade_out = crossfade_out;
+
+		// Keep the last crossfade_out samples and any data read ahead in the
+		// buffer. Samples before that are moved to the pre-roll buffer.
+		seek(offs_end - crossfade_out);
+		if (search > 0) {
+			has_next_block = true;
+			next_block_offs = read_offs();
+			next_block_idx = next_idx + 1;
+		}
 
 		return true;
 	}
 
 	size_t idx() const
 	{
-		// Calculate the index based on the length of one chunk in samples.
-		size_t idx = (read_offs() + settings.overlap_samples()) /
-		             (settings.length_samples() + settings.overlap_samples());
-
-		// Calculate the offset for this index in samples
-		const size_t idx_offs = settings.offs_for_block_idx_samples(idx);
-
-		// If the read offset is beyond the index at which the actual segment
-		// would start, this segment cannot be produced. Increment the index by
-		// one, since we can only output the next segment.
-		if (read_offs() > idx_offs) {
-			idx++;
+		// If the boundaries are adapted to the signal, the index of the next
+		// block is known.
+		if (has_next_block) {
+			return next_block_idx;
 		}
 
-		return idx;
+		// Otherwise the index of the next block is the index of the first
+		// block starting at or after the current read offset
+		return planner.block_idx_for_offs_samples(read_offs());
 	}
 };
 
@@ -218,10 +1124,29 @@ bool ChunkTranscoder::transcode(std::ostream &os)
 	return m_impl->transcode(os);
 }
 
+void ChunkTranscoder::write_init(std::ostream &os) const
+{
+	// Use the channel count of the stream rather than that of the last chunk
+	Encoder::write_headers(os, Encoder::Tags(),
+	                       m_impl->encoder_settings()
+	                           .channels(m_impl->settings.channels())
+	                           .headers(true));
+}
+
+size_t ChunkTranscoder::chunk_size(size_t length) const
+{
+	return m_impl->chunk_size(length);
+}
+
 size_t ChunkTranscoder::idx() const { return m_impl->idx(); }
 
 bool ChunkTranscoder::has_next() const { return !m_impl->at_end; }
 
+const ChunkTranscoder::Chunk &ChunkTranscoder::last_chunk() const
+{
+	return m_impl->chunk;
+}
+
 ChunkTranscoder::Settings ChunkTranscoder::settings() const
 {
 	return m_impl->settings;
@@ -35,6 +35,10 @@
 #include <functional>
 #include <iosfwd>
 #include <memory>
+#include <vector>
+
+#include "encoder.hpp"
+#include "sample_format.hpp"
 
 namespace eolian {
 namespace stream {
@@ -55,17 +59,44 @@ private:
 public:
 	/**
 	 * The Settings class conviniently stores the settings for the
-	 * ChunkTranscoder and allows to compute important quantities such as the
-	 * required second offset the decoder should seek to when encoding a chunk
-	 * with a certain index.
+	 * ChunkTranscoder. Quantities such as the offset the decoder should seek
+	 * to when encoding a chunk with a certain index are computed by the
+	 * ChunkPlanner class.
 	 */
 	class Settings {
 	private:
 		size_t m_rate = 48000;
+		size_t m_input_rate = 0;
+		SampleFormat m_input_format = SampleFormat::F32LE;
+		size_t m_input_channels = 0;
 		size_t m_channels = 2;
 		size_t m_bitrate = 256000;
 		float m_overlap = 1.0e-3f;
-		float m_length = 5.0f;
+		std::vector<float> m_schedule{5.0f};
+		float m_seek_interval = 0.0f;
+		bool m_context = false;
+		float m_search = 0.0f;
+		bool m_headerless = false;
+		size_t m_packet_frames = 1;
+		float m_frame_duration = 20.0f;
+		size_t m_complexity = 10;
+		Encoder::VBRMode m_vbr_mode = Encoder::VBRMode::VBR;
+		Encoder::Signal m_signal = Encoder::Signal::AUTO;
+		Encoder::Bandwidth m_max_bandwidth = Encoder::Bandwidth::FULLBAND;
+		bool m_auto_bandwidth = false;
+		size_t m_lsb_depth = 24;
+		float m_silence_threshold = 0.0f;
+		bool m_dtx = false;
+		bool m_dedup = false;
+		float m_dual_mono_threshold = 0.0f;
+		float m_target_rtf = 0.0f;
+		float m_rtf_headroom = 0.25f;
+		float m_target_snr = 0.0f;
+		size_t m_min_bitrate = 24000;
+		std::vector<size_t> m_chunk_bitrates;
+		bool m_auto_signal = false;
+		size_t m_speech_bitrate = 32000;
+		bool m_constant_size = false;
 
 	public:
 		/**
@@ -96,6 +127,80 @@ public:
 			return *this;
 		}
 
+		/**
+		 * Returns the sample rate of the data provided by the decoder in
+		 * samples per second. Zero if it is equal to rate(), which is the
+		 * default.
+		 */
+		size_t input_rate() const { return m_input_rate; }
+
+		/**
+		 * Sets the sample rate of the data provided by the decoder. If it
+		 * differs from rate(), the input is converted to rate() using the
+		 * Resampler class. The resampler state is kept over the whole stream,
+		 * so chunk boundaries and overlaps remain sample-exact w.r.t. rate().
+		 * The decoder offset passed to the ChunkTranscoder is measured at
+		 * rate() and must correspond to an integer input sample position.
+		 *
+		 * @param input_rate is the input sample rate in samples per second
+		 * or zero if no conversion should take place.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &input_rate(size_t input_rate)
+		{
+			assert(input_rate == 0 ||
+			       (input_rate >= 8000 && input_rate <= 384000));
+			m_input_rate = input_rate;
+			return *this;
+		}
+
+		/**
+		 * Returns the format of the RAW samples read from an input stream.
+		 * Default value is SampleFormat::F32LE.
+		 */
+		SampleFormat input_format() const { return m_input_format; }
+
+		/**
+		 * Sets the format of the RAW samples read from an input stream. Only
+		 * applies to the ChunkTranscoder constructor reading from an
+		 * std::istream; decoder callbacks always provide floating point
+		 * samples.
+		 *
+		 * @param input_format is the format of the RAW samples.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &input_format(SampleFormat input_format)
+		{
+			m_input_format = input_format;
+			return *this;
+		}
+
+		/**
+		 * Returns the number of interleaved channels in the input stream.
+		 * Zero if it is equal to channels(), which is the default.
+		 */
+		size_t input_channels() const { return m_input_channels; }
+
+		/**
+		 * Sets the number of interleaved channels in the input stream. If it
+		 * differs from channels(), all input channels are mixed down to mono,
+		 * in which case channels() must be one. Only applies to the
+		 * ChunkTranscoder constructor reading from an std::istream.
+		 *
+		 * @param input_channels is the number of channels in the input stream
+		 * or zero if it is equal to channels().
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &input_channels(size_t input_channels)
+		{
+			assert(input_channels <= 8);
+			m_input_channels = input_channels;
+			return *this;
+		}
+
 		/**
 		 * Returns the number of channels used by the ChunkTranscoder.
 		 */
@@ -104,7 +209,9 @@ public:
 		/**
 		 * Sets the number of channels used by the ChunkTranscoder. Possible
 		 * values are limited to those supported by the Opus codec -- the stream
-		 * can either be mono or stereo. Default value is two.
+		 * can be mono, stereo, or up to eight channels in Vorbis channel order
+		 * (e.g. 5.1 or 7.1), which are coded as an Opus multistream using
+		 * channel mapping family 1. Default value is two.
 		 *
 		 * @param channels is the number of channels in the stream.
 		 * @return a reference at this Settings instance for function call
@@ -112,7 +219,7 @@ public:
 		 */
 		Settings &channels(size_t channels)
 		{
-			assert(channels >= 1 && channels <= 2);
+			assert(channels >= 1 && channels <= 8);
 			m_channels = channels;
 			return *this;
 		}
@@ -168,19 +275,21 @@ public:
 		}
 
 		/**
-		 * Returns the length of one chunk in seconds. The default value is 5.0
+		 * Returns the steady-state length of one chunk in seconds, i.e. the
+		 * last entry in the chunk length schedule. The default value is 5.0
 		 * seconds.
 		 */
-		float length() const { return m_length; }
+		float length() const { return m_schedule.back(); }
 
 		/**
 		 * Returns the lnegth of one chunk in samples. The default value at a
 		 * sampling rate of 48000 is 240000.
 		 */
-		size_t length_samples() const { return m_length * m_rate; }
+		size_t length_samples() const { return length() * m_rate; }
 
 		/**
-		 * Sets the chunk length to the given length in seconds.
+		 * Sets the chunk length to the given length in seconds. All chunks
+		 * will have the same length.
 		 *
 		 * @param length is the length of one audio chunk in seconds. Must be
 		 * a positive number.
@@ -189,70 +298,788 @@ public:
 		 */
 		Settings &length(float length)
 		{
-			assert(length > 0.0f);
-			m_length = length;
+			return schedule({length});
+		}
+
+		/**
+		 * Returns the chunk length schedule in seconds.
+		 */
+		const std::vector<float> &schedule() const { return m_schedule; }
+
+		/**
+		 * Sets the chunk length schedule. The i-th chunk after the beginning
+		 * of the stream (or after a seek point) has the length of the i-th
+		 * entry in the schedule; the last entry is the steady-state length of
+		 * all following chunks. A schedule such as {0.5, 1.0, 2.0, 5.0}
+		 * provides short chunks for a fast start while keeping the per-chunk
+		 * overhead low in the long run.
+		 *
+		 * @param schedule is a non-empty list of chunk lengths in seconds. All
+		 * lengths must be positive numbers.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &schedule(const std::vector<float> &schedule)
+		{
+			assert(!schedule.empty());
+			assert(std::all_of(schedule.begin(), schedule.end(),
+			                   [](float length) { return length > 0.0f; }));
+			m_schedule = schedule;
+			return *this;
+		}
+
+		/**
+		 * Returns the interval between seek points in seconds. The chunk
+		 * length schedule restarts at each seek point. Default value is zero,
+		 * in which case the schedule only starts at the beginning of the
+		 * stream.
+		 */
+		float seek_interval() const { return m_seek_interval; }
+
+		/**
+		 * Returns the interval between seek points in samples.
+		 */
+		size_t seek_interval_samples() const
+		{
+			return m_seek_interval * m_rate;
+		}
+
+		/**
+		 * Sets the interval between seek points in seconds. The chunk length
+		 * schedule restarts at each multiple of this interval, such that a
+		 * client seeking to a seek point starts playback with short chunks.
+		 *
+		 * @param seek_interval is the interval in seconds. Must be zero (no
+		 * seek points) or larger than the overlap.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &seek_interval(float seek_interval)
+		{
+			assert(seek_interval >= 0.0f);
+			m_seek_interval = seek_interval;
+			return *this;
+		}
+
+		/**
+		 * Returns true if real audio data surrounding a chunk is used for the
+		 * lead-in and lead-out frames instead of data generated with linear
+		 * predictive coding. Default value is false.
+		 */
+		bool context() const { return m_context; }
+
+		/**
+		 * Enables or disables the use of real audio data surrounding a chunk
+		 * for the lead-in and lead-out frames. Linear predictive coding is
+		 * then only used at the actual boundaries of the stream. This removes
+		 * prediction artifacts and allows to use much smaller overlaps.
+		 *
+		 * @param context if true, neighbouring audio data is used for the
+		 * lead-in and lead-out frames.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &context(bool context)
+		{
+			m_context = context;
+			return *this;
+		}
+
+		/**
+		 * Returns the size of the window in seconds on either side of a
+		 * nominal chunk boundary that is searched for a better boundary
+		 * location. Default value is zero, i.e. the chunk boundaries are not
+		 * adapted to the signal.
+		 */
+		float search() const { return m_search; }
+
+		/**
+		 * Returns the size of the boundary search window in samples.
+		 */
+		size_t search_samples() const { return m_search * m_rate; }
+
+		/**
+		 * Sets the size of the window on either side of a nominal chunk
+		 * boundary that is searched for the boundary location with the lowest
+		 * signal energy. Placing boundaries at quiet points instead of
+		 * transients allows for much smaller overlaps. Note that the actual
+		 * chunk offsets and lengths then deviate from those computed by the
+		 * ChunkPlanner. When starting
+		 * at a decoder offset other than zero, the decoder should be
+		 * positioned at least search() + overlap() seconds plus half a frame
+		 * before the nominal start of the first block for the boundaries to
+		 * match those of a sequential run.
+		 *
+		 * @param search is the size of the search window in seconds. Must be
+		 * a non-negative number smaller than half the shortest chunk length.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &search(float search)
+		{
+			assert(search >= 0.0f);
+			m_search = search;
+			return *this;
+		}
+
+		/**
+		 * Returns true if the chunks are written without Ogg/Opus id and
+		 * comment headers. Default value is false.
+		 */
+		bool headerless() const { return m_headerless; }
+
+		/**
+		 * Enables or disables the header-less chunk mode. In this mode each
+		 * chunk starts with a binary Descriptor holding the crossfade
+		 * metadata, followed by the Ogg pages containing the audio data. The
+		 * id and comment headers shared by all chunks are written once using
+		 * write_init() and must be prepended to the Ogg pages (after removing
+		 * the descriptor) to obtain a standalone Ogg/Opus file.
+		 *
+		 * @param headerless if true, chunks are written without headers.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &headerless(bool headerless)
+		{
+			m_headerless = headerless;
+			return *this;
+		}
+
+		/**
+		 * Returns the maximum number of frames merged into a single Opus
+		 * packet. Default value is one.
+		 */
+		size_t packet_frames() const { return m_packet_frames; }
+
+		/**
+		 * Sets the maximum number of consecutive frames merged into a single
+		 * multi-frame Opus packet. Larger packets reduce the per-packet Ogg
+		 * lacing and TOC overhead, which is noticeable at low bitrates.
+		 *
+		 * @param packet_frames is the number of frames per packet. The total
+		 * duration of a packet, i.e. packet_frames() * frame_duration(), may
+		 * not exceed 120ms. Must be one for more than two channels.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &packet_frames(size_t packet_frames)
+		{
+			assert(packet_frames >= 1 && packet_frames <= 48);
+			m_packet_frames = packet_frames;
+			return *this;
+		}
+
+		/**
+		 * Returns the duration of a single Opus frame in milliseconds. Default
+		 * value is 20ms.
+		 */
+		float frame_duration() const { return m_frame_duration; }
+
+		/**
+		 * Returns the number of samples in a single Opus frame.
+		 */
+		size_t frame_size() const
+		{
+			return size_t(m_frame_duration * m_rate) / 1000;
+		}
+
+		/**
+		 * Sets the duration of a single Opus frame. Short frames reduce the
+		 * latency, long frames reduce the per-packet overhead and the number
+		 * of encoder calls. Note that the lead-in and lead-out frames scale
+		 * with the frame duration.
+		 *
+		 * @param frame_duration is the frame duration in milliseconds. Valid
+		 * values are 2.5, 5, 10, 20, 40 and 60.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &frame_duration(float frame_duration)
+		{
+			assert(frame_duration == 2.5f || frame_duration == 5.0f ||
+			       frame_duration == 10.0f || frame_duration == 20.0f ||
+			       frame_duration == 40.0f || frame_duration == 60.0f);
+			m_frame_duration = frame_duration;
+			return *this;
+		}
+
+		/**
+		 * Returns the computational complexity of the Opus encoder. Default
+		 * value is ten.
+		 */
+		size_t complexity() const { return m_complexity; }
+
+		/**
+		 * Sets the computational complexity of the Opus encoder. Lower values
+		 * trade quality for encoding speed; a complexity of five roughly
+		 * doubles the throughput compared to the default.
+		 *
+		 * @param complexity is a value between zero and ten.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &complexity(size_t complexity)
+		{
+			assert(complexity <= 10);
+			m_complexity = complexity;
+			return *this;
+		}
+
+		/**
+		 * Returns the rate control mode. Default value is unconstrained VBR.
+		 */
+		Encoder::VBRMode vbr_mode() const { return m_vbr_mode; }
+
+		/**
+		 * Sets the rate control mode, i.e. unconstrained variable bitrate,
+		 * constrained variable bitrate or constant bitrate.
+		 *
+		 * @param vbr_mode is the rate control mode.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &vbr_mode(Encoder::VBRMode vbr_mode)
+		{
+			m_vbr_mode = vbr_mode;
+			return *this;
+		}
+
+		/**
+		 * Returns the signal type hint passed to the encoder. Default value
+		 * is Encoder::Signal::AUTO.
+		 */
+		Encoder::Signal signal() const { return m_signal; }
+
+		/**
+		 * Tells the encoder whether the input is speech or music, which
+		 * biases the choice between the SILK and CELT coding modes.
+		 *
+		 * @param signal is the signal type hint.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &signal(Encoder::Signal signal)
+		{
+			m_signal = signal;
+			return *this;
+		}
+
+		/**
+		 * Returns the maximum bandwidth the encoder may use. Default value is
+		 * Encoder::Bandwidth::FULLBAND.
+		 */
+		Encoder::Bandwidth max_bandwidth() const { return m_max_bandwidth; }
+
+		/**
+		 * Limits the audio bandwidth the encoder may use.
+		 *
+		 * @param max_bandwidth is the maximum bandwidth.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &max_bandwidth(Encoder::Bandwidth max_bandwidth)
+		{
+			m_max_bandwidth = max_bandwidth;
+			return *this;
+		}
+
+		/**
+		 * Returns true if the bandwidth of each chunk is limited to the
+		 * detected bandwidth of the signal. Default value is false.
+		 */
+		bool auto_bandwidth() const { return m_auto_bandwidth; }
+
+		/**
+		 * Enables the automatic bandwidth detection. The spectrum of each
+		 * chunk is analysed (see BandwidthDetector) and the encoder bandwidth
+		 * is limited to the narrowest Opus bandwidth covering the signal, but
+		 * never exceeds max_bandwidth(). This prevents bits from being spent
+		 * on empty high frequency bands, e.g. for upsampled or telephone
+		 * recordings.
+		 *
+		 * @param auto_bandwidth if true, the bandwidth is detected for each
+		 * chunk.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &auto_bandwidth(bool auto_bandwidth)
+		{
+			m_auto_bandwidth = auto_bandwidth;
+			return *this;
+		}
+
+		/**
+		 * Returns the bit depth of the input signal. Default value is 24.
+		 */
+		size_t lsb_depth() const { return m_lsb_depth; }
+
+		/**
+		 * Sets the bit depth of the input signal, e.g. 16 for audio decoded
+		 * from CD sources. The encoder does not spend bits on signal
+		 * components below the least significant bit.
+		 *
+		 * @param lsb_depth is the bit depth between 8 and 24.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &lsb_depth(size_t lsb_depth)
+		{
+			assert(lsb_depth >= 8 && lsb_depth <= 24);
+			m_lsb_depth = lsb_depth;
+			return *this;
+		}
+
+		/**
+		 * Returns the peak amplitude below which audio is treated as silent
+		 * or zero if the silence detection is disabled. Default value is
+		 * zero.
+		 */
+		float silence_threshold() const { return m_silence_threshold; }
+
+		/**
+		 * Enables the silence fast path. Frames with a peak amplitude below
+		 * the threshold are encoded as digital silence (see
+		 * Encoder::Settings::silence_threshold()). Chunks that are silent in
+		 * their entirety, including the pre- and post-roll, are copied from
+		 * a template if a silent chunk with the same length, crossfades and
+		 * encoder parameters has been encoded before.
+		 *
+		 * @param silence_threshold is the peak amplitude, e.g. 1.0f / 32768.0f
+		 * for silence at 16 bit resolution.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &silence_threshold(float silence_threshold)
+		{
+			assert(silence_threshold >= 0.0f && silence_threshold < 1.0f);
+			m_silence_threshold = silence_threshold;
+			return *this;
+		}
+
+		/**
+		 * Returns true if discontinuous transmission is enabled. Default
+		 * value is false.
+		 */
+		bool dtx() const { return m_dtx; }
+
+		/**
+		 * Enables discontinuous transmission (see Encoder::Settings::dtx()).
+		 *
+		 * @param dtx if true, the encoder may emit empty packets during
+		 * silence.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &dtx(bool dtx)
+		{
+			m_dtx = dtx;
+			return *this;
+		}
+
+		/**
+		 * Returns true if duplicate chunks are detected. Default value is
+		 * false.
+		 */
+		bool dedup() const { return m_dedup; }
+
+		/**
+		 * Enables the detection of duplicate chunks. Before encoding a chunk,
+		 * a hash over the audio data passed to the encoder and the encoder
+		 * parameters is computed. If a recently encoded chunk has the same
+		 * hash, its encoded data is reused instead of invoking the encoder.
+		 * Has no effect if target_rtf() is set, since the encoder complexity
+		 * then depends on timing.
+		 *
+		 * @param dedup if true, duplicate chunks are copied.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &dedup(bool dedup)
+		{
+			m_dedup = dedup;
+			return *this;
+		}
+
+		/**
+		 * Returns the relative side signal energy below which a stereo chunk
+		 * is encoded as mono or zero if the dual-mono detection is disabled.
+		 * Default value is zero.
+		 */
+		float dual_mono_threshold() const { return m_dual_mono_threshold; }
+
+		/**
+		 * Enables the dual-mono detection for stereo input. If the energy of
+		 * the side signal L - R of a chunk relative to the energy of the mid
+		 * signal L + R is below the threshold, the chunk is mixed down and
+		 * encoded as a mono Opus stream at half the bitrate. Decoders upmix
+		 * such chunks according to the channel count in the OpusHead header.
+		 * Cannot be combined with headerless(), since header-less chunks
+		 * share a single OpusHead header.
+		 *
+		 * @param dual_mono_threshold is the energy ratio, e.g. 1e-4f for
+		 * channels differing by less than -40 dB.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &dual_mono_threshold(float dual_mono_threshold)
+		{
+			assert(dual_mono_threshold >= 0.0f);
+			m_dual_mono_threshold = dual_mono_threshold;
+			return *this;
+		}
+
+		/**
+		 * Returns the target real-time factor, i.e. the wall-clock time spent
+		 * encoding a chunk divided by the duration of the chunk. Default value
+		 * is zero, which disables the adaptive complexity control.
+		 */
+		float target_rtf() const { return m_target_rtf; }
+
+		/**
+		 * Enables the adaptive complexity control. The encoding time of each
+		 * frame is measured and the encoder complexity is lowered whenever
+		 * the real-time factor exceeds the target (minus the headroom), and
+		 * raised again up to complexity() if there is sufficient slack. This
+		 * ensures that live streams keep up even on overloaded machines.
+		 *
+		 * @param target_rtf is the target real-time factor, e.g. 0.5 to
+		 * encode each chunk in at most half its duration. Zero disables the
+		 * adaptive complexity control.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &target_rtf(float target_rtf)
+		{
+			assert(target_rtf >= 0.0f);
+			m_target_rtf = target_rtf;
 			return *this;
 		}
 
 		/**
-		 * Returns the offset in seconds an audio block with the given index
-		 * would start at (including overlap).
+		 * Returns the fraction of the target real-time factor that is kept
+		 * in reserve. Default value is 0.25.
+		 */
+		float rtf_headroom() const { return m_rtf_headroom; }
+
+		/**
+		 * Sets the fraction of the target real-time factor kept in reserve to
+		 * absorb load spikes. The adaptive complexity control aims at a
+		 * real-time factor of target_rtf() * (1 - rtf_headroom()).
+		 *
+		 * @param rtf_headroom is a value between zero and one.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
 		 */
-		float offs_for_block_idx(size_t idx) const
+		Settings &rtf_headroom(float rtf_headroom)
 		{
-			return offs_for_block_idx_samples(idx) / float(m_rate);
+			assert(rtf_headroom >= 0.0f && rtf_headroom < 1.0f);
+			m_rtf_headroom = rtf_headroom;
+			return *this;
 		}
 
 		/**
-		 * Returns the offset in samples an audio block with the given index
-		 * would start at (including overlap).
+		 * Returns the target quality as segmental signal-to-noise ratio in
+		 * dB. Default value is zero, which disables the quality-targeted
+		 * bitrate search.
 		 */
-		size_t offs_for_block_idx_samples(size_t idx) const
+		float target_snr() const { return m_target_snr; }
+
+		/**
+		 * Enables the quality-targeted bitrate search. Each chunk is encoded,
+		 * decoded and compared to the original audio; the chunk is written
+		 * with the lowest bitrate between min_bitrate() and bitrate() for
+		 * which the segmental SNR of the decoded audio reaches the target.
+		 * The chosen bitrate is stored in the BITRATE tag of each chunk.
+		 * Note that this requires multiple trial encodes per chunk.
+		 *
+		 * @param target_snr is the target segmental SNR in dB. Zero disables
+		 * the bitrate search.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &target_snr(float target_snr)
 		{
-			return std::max<int64_t>(
-			    (int64_t(m_length * m_rate) + int64_t(m_overlap * m_rate)) *
-			            idx -
-			        int64_t(m_overlap * m_rate),
-			    0);
+			assert(target_snr >= 0.0f);
+			m_target_snr = target_snr;
+			return *this;
 		}
 
 		/**
-		 * Returns the offset in seconds an audio block with the given index
-		 * would end at (including overlap).
+		 * Returns the lowest bitrate considered by the quality-targeted
+		 * bitrate search. Default value is 24000.
 		 */
-		float offs_end_for_block_idx(size_t idx) const
+		size_t min_bitrate() const { return m_min_bitrate; }
+
+		/**
+		 * Sets the lowest bitrate considered by the quality-targeted bitrate
+		 * search. The highest bitrate is given by bitrate().
+		 *
+		 * @param min_bitrate is the minimum bitrate in bits per second.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &min_bitrate(size_t min_bitrate)
 		{
-			return offs_end_for_block_idx_samples(idx) / float(m_rate);
+			assert(min_bitrate >= 500 && min_bitrate <= 512000);
+			m_min_bitrate = min_bitrate;
+			return *this;
 		}
 
 		/**
-		 * Returns the offset in samples an audio block with the given index
-		 * would end at (including overlap).
+		 * Returns the list of per-chunk bitrates. Default value is an empty
+		 * list, in which case all chunks are encoded with bitrate().
 		 */
-		size_t offs_end_for_block_idx_samples(size_t idx) const
+		const std::vector<size_t> &chunk_bitrates() const
 		{
-			return std::max<int64_t>(
-			    (int64_t(m_length * m_rate) + int64_t(m_overlap * m_rate)) *
-			        (idx + 1),
-			    0);
+			return m_chunk_bitrates;
 		}
 
 		/**
-		 * Returns the maximum total length (i.e. including the overlap at the
-		 * beginning and the end) of a single chunk in seconds.
+		 * Sets an individual bitrate for each chunk, e.g. as computed by the
+		 * first pass of a two-pass encode using the BitBudget class. Chunks
+		 * with an index beyond the end of the list use the last bitrate in
+		 * the list. The bitrate of each chunk is stored in its BITRATE tag.
+		 * Since the BitBudget assigns the audio to chunks according to the
+		 * planned chunk boundaries, per-chunk bitrates cannot be combined
+		 * with search().
+		 *
+		 * @param chunk_bitrates is a list containing the bitrate in bits per
+		 * second for each chunk index.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
 		 */
-		float total_length() const { return m_length + 2 * m_overlap; }
+		Settings &chunk_bitrates(const std::vector<size_t> &chunk_bitrates)
+		{
+			assert(std::all_of(chunk_bitrates.begin(), chunk_bitrates.end(),
+			                   [](size_t x) { return x >= 500 && x <= 512000; }));
+			m_chunk_bitrates = chunk_bitrates;
+			return *this;
+		}
 
 		/**
-		 * Returns the maximum total length (i.e. including the overlap at the
-		 * beginning and the end) of a single chunk in samples.
+		 * Returns true if each chunk is classified as speech or music. Default
+		 * value is false.
 		 */
-		size_t total_length_samples() const
+		bool auto_signal() const { return m_auto_signal; }
+
+		/**
+		 * Enables the speech/music classification (see SignalClassifier).
+		 * The signal type hint passed to the encoder is set according to the
+		 * classification of each chunk, and speech chunks are encoded with
+		 * at most speech_bitrate(). This overrides signal().
+		 *
+		 * @param auto_signal if true, each chunk is classified.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &auto_signal(bool auto_signal)
 		{
-			return length_samples() + 2 * overlap_samples();
+			m_auto_signal = auto_signal;
+			return *this;
+		}
+
+		/**
+		 * Returns the maximum bitrate of chunks classified as speech in bits
+		 * per second. Default value is 32000.
+		 */
+		size_t speech_bitrate() const { return m_speech_bitrate; }
+
+		/**
+		 * Sets the maximum bitrate of chunks classified as speech. Only used
+		 * if auto_signal() is true.
+		 *
+		 * @param speech_bitrate is the bitrate in bits per second.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &speech_bitrate(size_t speech_bitrate)
+		{
+			assert(speech_bitrate >= 500 && speech_bitrate <= 512000);
+			m_speech_bitrate = speech_bitrate;
+			return *this;
+		}
+
+		/**
+		 * Returns the (maximum) bitrate the chunk with the given index is
+		 * encoded with.
+		 */
+		size_t bitrate_for_chunk(size_t idx) const
+		{
+			if (m_chunk_bitrates.empty()) {
+				return m_bitrate;
+			}
+			return m_chunk_bitrates[std::min(idx, m_chunk_bitrates.size() - 1)];
+		}
+
+		/**
+		 * Returns true if the bitrate may differ between chunks, i.e. if
+		 * per-chunk bitrates are given, the quality-targeted bitrate search
+		 * is enabled, or speech or dual-mono chunks are encoded at a lower
+		 * bitrate.
+		 */
+		bool per_chunk_bitrate() const
+		{
+			return !m_chunk_bitrates.empty() || m_target_snr > 0.0f ||
+			       m_auto_signal || m_dual_mono_threshold > 0.0f;
+		}
+
+		/**
+		 * Returns true if the size of each chunk in bytes only depends on its
+		 * length. Default value is false.
+		 */
+		bool constant_size() const { return m_constant_size; }
+
+		/**
+		 * Enables the constant-size chunk mode. Chunks are encoded with
+		 * constant bitrate, each Opus packet is padded to the same size, each
+		 * Ogg page holds the same number of packets, and the comment header
+		 * values are zero-padded to a fixed width. Hence the size of a chunk
+		 * is a function of its length (see ChunkTranscoder::chunk_size()),
+		 * which allows clients to compute byte offsets without an index. Each
+		 * chunk is checked against this invariant before being written.
+		 * Requires packet_frames() to be one, at most two channels, and
+		 * neither chunk_bitrates(), target_snr(), auto_signal() nor
+		 * dual_mono_threshold() to be set.
+		 *
+		 * @param constant_size if true, the constant-size mode is enabled.
+		 * @return a reference at this Settings instance for function call
+		 * chaining.
+		 */
+		Settings &constant_size(bool constant_size)
+		{
+			m_constant_size = constant_size;
+			return *this;
+		}
+
+		/**
+		 * Returns the size of each Opus packet in the constant-size mode.
+		 * This corresponds to the size of a constant bitrate Opus frame.
+		 */
+		size_t constant_packet_size() const
+		{
+			return (m_bitrate * frame_size() / m_rate + 4) / 8;
+		}
+
+		/**
+		 * Returns the number of packets in each Ogg page in the constant-size
+		 * mode. This is the maximum number of packets fitting into the 255
+		 * segments of an Ogg page.
+		 */
+		size_t constant_packets_per_page() const
+		{
+			return 255 / (constant_packet_size() / 255 + 1);
 		}
 	};
 
+	/**
+	 * The Chunk structure describes a chunk that has been written by the
+	 * transcode() function.
+	 */
+	struct Chunk {
+		/**
+		 * Index of the chunk.
+		 */
+		size_t idx = 0;
+
+		/**
+		 * Offset of the first sample of the chunk (including the crossfade)
+		 * within the original stream.
+		 */
+		size_t offs = 0;
+
+		/**
+		 * Total number of samples in the chunk (including the crossfades).
+		 */
+		size_t length = 0;
+
+		/**
+		 * Number of samples at the beginning of the chunk that are crossfaded
+		 * with the previous chunk.
+		 */
+		size_t crossfade_in = 0;
+
+		/**
+		 * Number of samples at the end of the chunk that are crossfaded with
+		 * the next chunk.
+		 */
+		size_t crossfade_out = 0;
+
+		/**
+		 * Encoder complexity used for the last frame of the chunk.
+		 */
+		size_t complexity = 0;
+
+		/**
+		 * Measured real-time factor, i.e. the wall-clock time spent encoding
+		 * the chunk divided by its duration.
+		 */
+		float rtf = 0.0f;
+
+		/**
+		 * Bitrate the chunk has been encoded with.
+		 */
+		size_t bitrate = 0;
+
+		/**
+		 * Segmental SNR of the decoded chunk in dB. Only measured if the
+		 * quality-targeted bitrate search is enabled.
+		 */
+		float snr = 0.0f;
+
+		/**
+		 * Maximum bandwidth the chunk has been encoded with. Only differs
+		 * from Settings::max_bandwidth() if the automatic bandwidth detection
+		 * is enabled.
+		 */
+		Encoder::Bandwidth bandwidth = Encoder::Bandwidth::FULLBAND;
+
+		/**
+		 * Signal type hint the chunk has been encoded with. Only differs from
+		 * Settings::signal() if the speech/music classification is enabled.
+		 */
+		Encoder::Signal signal = Encoder::Signal::AUTO;
+
+		/**
+		 * True if the chunk, including the pre- and post-roll, is silent.
+		 * Only detected if Settings::silence_threshold() is non-zero.
+		 */
+		bool silent = false;
+
+		/**
+		 * True if the encoded chunk has been copied from an identical chunk
+		 * encoded before. Only detected if Settings::dedup() is true.
+		 */
+		bool duplicate = false;
+
+		/**
+		 * Number of channels the chunk has been encoded with. Smaller than
+		 * Settings::channels() if a dual-mono chunk has been encoded as mono.
+		 */
+		size_t channels = 0;
+
+		/**
+		 * Number of bytes written to the output stream for this chunk,
+		 * including the descriptor in header-less mode. Zero if the position
+		 * of the output stream cannot be determined.
+		 */
+		size_t size = 0;
+	};
+
+#pragma pack(push)
+#pragma pack(1)
+	/**
+	 * Binary descriptor preceding each chunk in header-less mode. All integers
+	 * are stored in little endian byte order.
+	 */
+	struct Descriptor {
+		uint8_t magic[4] = {0x4f, 0x70, 0x43, 0x46};  // "OpCF"
+		uint8_t version = 1;
+		uint32_t crossfade_in = 0;
+		uint32_t crossfade_out = 0;
+	};
+#pragma pack(pop)
+
 	/**
 	 * Callback called whenever data must be read from the decoder.
 	 *
@@ -283,7 +1110,8 @@ public:
 
 	/**
 	 * Instantiates the ChunkTranscoder class reading RAW data from an input
-	 * stream.
+	 * stream. The samples are converted from Settings::input_format() and
+	 * mixed down from Settings::input_channels() while they are read.
 	 *
 	 * @param decoder is a callback function that provides RAW floating point
 	 * sample data.
@@ -313,6 +1141,25 @@ public:
 	 */
 	bool transcode(std::ostream &os);
 
+	/**
+	 * Writes the initialisation segment, i.e. the Ogg/Opus id and comment
+	 * headers shared by all chunks, to the given output stream. Only required
+	 * if Settings::headerless() is true.
+	 *
+	 * @param os is the output stream the headers should be written to.
+	 */
+	void write_init(std::ostream &os) const;
+
+	/**
+	 * Returns the size in bytes of a chunk with the given length (including
+	 * the crossfades) in the constant-size mode. In header-less mode this
+	 * includes the size of the descriptor. Returns zero if
+	 * Settings::constant_size() is false.
+	 *
+	 * @param length is the total number of samples in the chunk.
+	 */
+	size_t chunk_size(size_t length) const;
+
 	/**
 	 * Returns the current chunk index of the transcoder. This corresponds to
 	 * the index of the next chunk that is going to be returned with a call to
@@ -327,6 +1174,12 @@ public:
 	 */
 	bool has_next() const;
 
+	/**
+	 * Returns the metadata describing the chunk written by the last successful
+	 * call to transcode().
+	 */
+	const Chunk &last_chunk() const;
+
 	/**
 	 * Returns the settings used for this ChunkTranscoder.
 	 */
@@ -0,0 +1,221 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <opus/opus.h>
+
+#include "chunk_transcoder.hpp"
+#include "chunk_validator.hpp"
+#include "ogg_opus_demuxer.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The ChunkValidationError class is used to report the first problem found
+ * in a chunk.
+ */
+class ChunkValidationError : public std::runtime_error {
+public:
+	ChunkValidationError(const std::string &msg) : std::runtime_error(msg) {}
+};
+
+static constexpr size_t PAGE_HEADER_SIZE = 27;
+static constexpr uint8_t HEADER_TYPE_FIRST = 0x02;
+static constexpr size_t DESCRIPTOR_SIZE = sizeof(ChunkTranscoder::Descriptor);
+
+static uint32_t read_u32(const uint8_t *p)
+{
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) |
+	       (uint32_t(p[3]) << 24);
+}
+
+/**
+ * Returns true if the given buffer starts with a header-less chunk
+ * descriptor.
+ */
+static bool is_descriptor(const uint8_t *data, size_t size)
+{
+	const ChunkTranscoder::Descriptor descr;
+	return size >= DESCRIPTOR_SIZE &&
+	       memcmp(data, descr.magic, sizeof(descr.magic)) == 0;
+}
+
+/**
+ * Parses a crossfade tag value.
+ */
+static size_t parse_tag(const std::string &key, const std::string &value)
+{
+	if (value.empty() ||
+	    value.find_first_not_of("0123456789") != std::string::npos) {
+		throw ChunkValidationError("Invalid " + key + " tag");
+	}
+	return std::stoul(value);
+}
+
+ChunkInfo validate_chunk(const uint8_t *data, size_t size,
+                         const ChunkInfo *init)
+{
+	ChunkInfo info;
+
+	// Read the descriptor of header-less chunks
+	const bool has_descriptor = is_descriptor(data, size);
+	if (has_descriptor) {
+		if (data[4] != ChunkTranscoder::Descriptor().version) {
+			throw ChunkValidationError("Unsupported descriptor version");
+		}
+		info.crossfade_in = read_u32(data + 5);
+		info.crossfade_out = read_u32(data + 9);
+		data += DESCRIPTOR_SIZE;
+		size -= DESCRIPTOR_SIZE;
+	}
+
+	// Parse the headers, this verifies the page checksums and sequence
+	// numbers of the header pages
+	OggOpusDemuxer demuxer(data, size);
+	info.has_headers = demuxer.has_headers();
+	if (has_descriptor == info.has_headers) {
+		throw ChunkValidationError(info.has_headers
+		                               ? "Descriptor followed by Opus headers"
+		                               : "Missing Opus headers");
+	}
+	bool has_cf_in = false, has_cf_out = false;
+	if (info.has_headers) {
+		info.channels = demuxer.channels();
+		info.pre_skip = demuxer.pre_skip();
+		if (info.channels == 0) {
+			throw ChunkValidationError("Invalid channel count");
+		}
+		for (const auto &tag : demuxer.tags()) {
+			if (std::get<0>(tag) == "CF_IN") {
+				info.crossfade_in = parse_tag("CF_IN", std::get<1>(tag));
+				has_cf_in = true;
+			}
+			else if (std::get<0>(tag) == "CF_OUT") {
+				info.crossfade_out = parse_tag("CF_OUT", std::get<1>(tag));
+				has_cf_out = true;
+			}
+		}
+	}
+	else {
+		// Header-less chunks are decoded with the id header of the init
+		// segment
+		if (!init || !init->has_headers || init->n_packets > 0) {
+			throw ChunkValidationError(
+			    "Header-less chunk without init segment");
+		}
+		info.channels = init->channels;
+		info.pre_skip = init->pre_skip;
+	}
+
+	// Check the duration of each packet and the granule positions. The
+	// granule position of a page must not exceed the number of samples
+	// decoded up to that page and must not decrease.
+	OggOpusDemuxer::Packet packet;
+	size_t n_samples = 0;
+	int64_t granule = -1;
+	bool last = false;
+	while (demuxer.next(packet)) {
+		if (last) {
+			throw ChunkValidationError("Packets after the end of the stream");
+		}
+		const int n =
+		    opus_packet_get_nb_samples(packet.data, packet.size, 48000);
+		if (n <= 0) {
+			throw ChunkValidationError("Invalid Opus packet");
+		}
+		n_samples += n;
+		if (packet.granule >= 0) {
+			if (packet.granule < granule ||
+			    size_t(packet.granule) > n_samples) {
+				throw ChunkValidationError("Invalid granule position");
+			}
+			granule = packet.granule;
+		}
+		last = packet.last;
+		info.n_packets++;
+	}
+
+	// Streams consisting only of the headers are initialisation segments,
+	// which do not carry any crossfade metadata
+	if (info.n_packets == 0 && info.has_headers) {
+		return info;
+	}
+	if (info.has_headers && (!has_cf_in || !has_cf_out)) {
+		throw ChunkValidationError("Missing CF_IN or CF_OUT tag");
+	}
+	if (!last || granule < 0) {
+		throw ChunkValidationError("Missing end of stream");
+	}
+
+	// The pre_skip must be covered by the decoded samples and the crossfades
+	// by the chunk length
+	if (size_t(granule) <= info.pre_skip) {
+		throw ChunkValidationError("Chunk shorter than pre_skip");
+	}
+	info.length = granule - info.pre_skip;
+	if (info.crossfade_in + info.crossfade_out > info.length) {
+		throw ChunkValidationError("Crossfades longer than the chunk");
+	}
+	return info;
+}
+
+std::vector<std::pair<size_t, size_t>> split_chunks(const uint8_t *data,
+                                                    size_t size)
+{
+	std::vector<std::pair<size_t, size_t>> res;
+	size_t offs = 0;
+	auto start_chunk = [&]() {
+		if (!res.empty()) {
+			res.back().second = offs - res.back().first;
+		}
+		res.emplace_back(offs, 0);
+	};
+	while (offs < size) {
+		const uint8_t *p = data + offs;
+		const size_t avail = size - offs;
+		if (is_descriptor(p, avail)) {
+			start_chunk();
+			offs += DESCRIPTOR_SIZE;
+			continue;
+		}
+		if (avail < PAGE_HEADER_SIZE || memcmp(p, "OggS", 4) != 0 ||
+		    avail < PAGE_HEADER_SIZE + p[26]) {
+			break;
+		}
+		if ((p[5] & HEADER_TYPE_FIRST) || res.empty()) {
+			start_chunk();
+		}
+		size_t page_size = PAGE_HEADER_SIZE + p[26];
+		for (size_t i = 0; i < p[26]; i++) {
+			page_size += p[PAGE_HEADER_SIZE + i];
+		}
+		offs += page_size;
+	}
+	if (res.empty()) {
+		res.emplace_back(0, size);
+	}
+	else {
+		res.back().second = size - res.back().first;
+	}
+	return res;
+}
+}
+}
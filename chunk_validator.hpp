@@ -0,0 +1,104 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file chunk_validator.hpp
+ *
+ * Provides functions for verifying the integrity of the Ogg/Opus chunks
+ * written by the ChunkTranscoder.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace eolian {
+namespace stream {
+/**
+ * Properties of a chunk determined while validating it.
+ */
+struct ChunkInfo {
+	/**
+	 * True if the chunk starts with the Opus id and comment headers, false
+	 * if it is a header-less chunk prefixed with a binary descriptor.
+	 */
+	bool has_headers = false;
+
+	/**
+	 * Number of channels and pre_skip stored in the id header. For
+	 * header-less chunks, these are taken from the init segment.
+	 */
+	size_t channels = 0;
+	size_t pre_skip = 0;
+
+	/**
+	 * Number of samples in the chunk after the pre_skip at 48000 samples/s.
+	 */
+	size_t length = 0;
+
+	/**
+	 * Crossfades stored in the CF_IN/CF_OUT tags or in the descriptor, in
+	 * samples at the sample rate the chunk was encoded at.
+	 */
+	size_t crossfade_in = 0;
+	size_t crossfade_out = 0;
+
+	/**
+	 * Number of Opus packets in the chunk.
+	 */
+	size_t n_packets = 0;
+};
+
+/**
+ * Validates a single chunk stored in the given buffer. Checks the checksum
+ * and sequence number of each Ogg page, the Opus headers, the duration of
+ * each packet, the granule positions, the pre_skip and the crossfade
+ * metadata. Throws an exception describing the first problem found.
+ *
+ * @param data is a pointer at the chunk.
+ * @param size is the size of the chunk in bytes.
+ * @param init is the result of validating the init segment (a stream
+ * consisting only of the Opus headers) that header-less chunks refer to.
+ * The number of channels and the pre_skip of header-less chunks are taken
+ * from the init segment. Header-less chunks are rejected if init is null.
+ * @return the properties of the chunk.
+ */
+ChunkInfo validate_chunk(const uint8_t *data, size_t size,
+                         const ChunkInfo *init = nullptr);
+
+/**
+ * Splits a buffer containing several concatenated chunks, e.g. a pack file
+ * created by concatenating chunk files, into the individual chunks. A new
+ * chunk starts at each Ogg page that marks the beginning of a logical stream
+ * and at each header-less chunk descriptor. Does not validate the pages.
+ *
+ * @param data is a pointer at the buffer.
+ * @param size is the size of the buffer in bytes.
+ * @return a list of offset and size pairs describing the individual chunks.
+ * Any data that cannot be parsed as an Ogg page is attributed to the
+ * preceding chunk, such that it is reported by validate_chunk().
+ */
+std::vector<std::pair<size_t, size_t>> split_chunks(const uint8_t *data,
+                                                    size_t size);
+}
+}
@@ -0,0 +1,73 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "complexity_controller.hpp"
+
+namespace eolian {
+namespace stream {
+/******************************************************************************
+ * Class ComplexityController                                                 *
+ ******************************************************************************/
+
+ComplexityController::ComplexityController(
+    const ChunkTranscoder::Settings &settings)
+    : m_rate(settings.rate()),
+      m_target(settings.target_rtf() * (1.0 - settings.rtf_headroom())),
+      m_max_complexity(settings.complexity()),
+      m_complexity(settings.complexity())
+{
+}
+
+bool ComplexityController::update(double seconds, size_t n_samples)
+{
+	if (n_samples == 0) {
+		return false;
+	}
+
+	// Update the smoothed real-time factor. The first measurement is used
+	// as is.
+	const double rtf = seconds * m_rate / n_samples;
+	m_rtf = m_has_rtf ? (1.0 - SMOOTHING) * m_rtf + SMOOTHING * rtf : rtf;
+	m_has_rtf = true;
+
+	// Wait for the smoothed value to reflect the last change
+	if (m_hold > 0) {
+		m_hold--;
+		return false;
+	}
+
+	// Lower the complexity if we're too slow, raise it if there is enough
+	// slack
+	size_t complexity = m_complexity;
+	if (m_rtf > m_target && complexity > 0) {
+		complexity--;
+	}
+	else if (m_rtf < RAISE_THRESHOLD * m_target &&
+	         complexity < m_max_complexity) {
+		complexity++;
+	}
+	if (complexity == m_complexity) {
+		return false;
+	}
+	m_complexity = complexity;
+	m_hold = HOLD;
+	m_n_changes++;
+	return true;
+}
+}
+}
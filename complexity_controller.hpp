@@ -0,0 +1,139 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file complexity_controller.hpp
+ *
+ * Declares the ComplexityController class which adapts the Opus encoder
+ * complexity to the available processing time.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "chunk_transcoder.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The ComplexityController class keeps track of the real-time factor (RTF) of
+ * the encoder, i.e. the ratio between the wall-clock time spent encoding and
+ * the duration of the encoded audio. Whenever the smoothed RTF exceeds the
+ * target, the encoder complexity is lowered by one step; if the RTF falls well
+ * below the target, the complexity is raised again. After each change the
+ * controller waits for the smoothed RTF to settle before changing the
+ * complexity again.
+ */
+class ComplexityController {
+private:
+	/**
+	 * Sample rate used to convert sample counts to seconds.
+	 */
+	size_t m_rate;
+
+	/**
+	 * Real-time factor the controller aims at, including the headroom.
+	 */
+	double m_target;
+
+	/**
+	 * Maximum complexity the controller may select.
+	 */
+	size_t m_max_complexity;
+
+	/**
+	 * Currently selected complexity.
+	 */
+	size_t m_complexity;
+
+	/**
+	 * Exponentially smoothed real-time factor.
+	 */
+	double m_rtf = 0.0;
+
+	/**
+	 * Set to true once the first measurement has been received.
+	 */
+	bool m_has_rtf = false;
+
+	/**
+	 * Number of updates to wait before the complexity may be changed again.
+	 */
+	size_t m_hold = 0;
+
+	/**
+	 * Total number of complexity changes.
+	 */
+	size_t m_n_changes = 0;
+
+public:
+	/**
+	 * Smoothing factor of the exponential moving average of the RTF.
+	 */
+	static constexpr double SMOOTHING = 0.1;
+
+	/**
+	 * Number of updates the controller waits after changing the complexity.
+	 */
+	static constexpr size_t HOLD = 10;
+
+	/**
+	 * The complexity is only raised if the RTF is below this fraction of the
+	 * target. This hysteresis prevents the controller from oscillating.
+	 */
+	static constexpr double RAISE_THRESHOLD = 0.6;
+
+	/**
+	 * Creates a new ComplexityController instance.
+	 *
+	 * @param settings are the ChunkTranscoder settings. The initial and
+	 * maximum complexity is given by Settings::complexity(), the target RTF by
+	 * Settings::target_rtf() and Settings::rtf_headroom().
+	 */
+	ComplexityController(const ChunkTranscoder::Settings &settings);
+
+	/**
+	 * Informs the controller about the time it took to encode a number of
+	 * samples and updates the complexity.
+	 *
+	 * @param seconds is the wall-clock time spent encoding.
+	 * @param n_samples is the number of samples that were encoded.
+	 * @return true if the complexity has been changed.
+	 */
+	bool update(double seconds, size_t n_samples);
+
+	/**
+	 * Returns the complexity that should be used for the next frame.
+	 */
+	size_t complexity() const { return m_complexity; }
+
+	/**
+	 * Returns the current smoothed real-time factor.
+	 */
+	double rtf() const { return m_rtf; }
+
+	/**
+	 * Returns the total number of complexity changes.
+	 */
+	size_t n_changes() const { return m_n_changes; }
+};
+}
+}
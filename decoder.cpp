@@ -0,0 +1,150 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+
+#include <opus/opus.h>
+#include <opus/opus_multistream.h>
+
+#include "decoder.hpp"
+
+namespace eolian {
+namespace stream {
+
+/******************************************************************************
+ * Class OpusDecoderError                                                     *
+ ******************************************************************************/
+
+/**
+ * Exception thrown if the Opus decoder reports an error.
+ */
+class OpusDecoderError : public std::runtime_error {
+public:
+	/**
+	 * Creates a new OpusDecoderError instance representing the given Opus
+	 * error code.
+	 */
+	OpusDecoderError(int err) : std::runtime_error(opus_strerror(err)) {}
+};
+
+/******************************************************************************
+ * Struct Decoder::Impl                                                       *
+ ******************************************************************************/
+
+/**
+ * Actual implementation of the Decoder class. Minimal RAII wrapper around the
+ * C opus_decoder and opus_multistream_decoder APIs.
+ */
+struct Decoder::Impl {
+	OpusDecoder *dec = nullptr;
+	OpusMSDecoder *ms_dec = nullptr;
+	size_t channels;
+	size_t rate;
+
+	Impl(size_t channels, size_t rate,
+	     const OggOpusMuxer::ChannelMapping &mapping)
+	    : channels(channels), rate(rate)
+	{
+		int err;
+		if (mapping.family == 0) {
+			dec = opus_decoder_create(rate, channels, &err);
+			if (!dec || err) {
+				throw OpusDecoderError(err);
+			}
+			return;
+		}
+		if (mapping.mapping.size() != channels) {
+			throw OpusDecoderError(OPUS_BAD_ARG);
+		}
+		ms_dec = opus_multistream_decoder_create(
+		    rate, channels, mapping.streams, mapping.coupled_streams,
+		    mapping.mapping.data(), &err);
+		if (!ms_dec || err) {
+			throw OpusDecoderError(err);
+		}
+	}
+
+	~Impl()
+	{
+		if (dec) {
+			opus_decoder_destroy(dec);
+			dec = nullptr;
+		}
+		if (ms_dec) {
+			opus_multistream_decoder_destroy(ms_dec);
+			ms_dec = nullptr;
+		}
+	}
+
+	size_t decode(const uint8_t *data, size_t size, float *tar, size_t n_tar)
+	{
+		const int res =
+		    ms_dec ? opus_multistream_decode_float(ms_dec, data, size, tar,
+		                                           n_tar, 0)
+		           : opus_decode_float(dec, data, size, tar, n_tar, 0);
+		if (res < 0) {
+			throw OpusDecoderError(res);
+		}
+		return res;
+	}
+
+	void reset()
+	{
+		if (ms_dec) {
+			opus_multistream_decoder_ctl(ms_dec, OPUS_RESET_STATE);
+		}
+		else {
+			opus_decoder_ctl(dec, OPUS_RESET_STATE);
+		}
+	}
+};
+
+/******************************************************************************
+ * Class Decoder                                                              *
+ ******************************************************************************/
+
+Decoder::Decoder(size_t channels, size_t rate)
+    : m_impl(std::make_unique<Impl>(channels, rate,
+                                    OggOpusMuxer::ChannelMapping()))
+{
+}
+
+Decoder::Decoder(size_t channels, size_t rate,
+                 const OggOpusMuxer::ChannelMapping &mapping)
+    : m_impl(std::make_unique<Impl>(channels, rate, mapping))
+{
+}
+
+Decoder::~Decoder()
+{
+	// Implicitly destroy m_impl
+}
+
+size_t Decoder::channels() const { return m_impl->channels; }
+
+size_t Decoder::rate() const { return m_impl->rate; }
+
+size_t Decoder::decode(const uint8_t *data, size_t size, float *tar,
+                       size_t n_tar)
+{
+	return m_impl->decode(data, size, tar, n_tar);
+}
+
+void Decoder::reset() { m_impl->reset(); }
+}
+}
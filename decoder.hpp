@@ -0,0 +1,112 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file decoder.hpp
+ *
+ * Provides a thin wrapper around the libopus decoder which decodes individual
+ * Opus packets to interleaved float samples.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "ogg_opus_muxer.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The Decoder class decodes individual Opus packets, such as the packets
+ * returned by the OggOpusDemuxer, to interleaved float samples.
+ */
+class Decoder {
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_impl;
+
+public:
+	/**
+	 * Creates a new Decoder instance. Throws an exception if the decoder
+	 * cannot be initialised.
+	 *
+	 * @param channels is the number of channels the decoded audio should
+	 * have. Must be one or two.
+	 * @param rate is the sample rate of the decoded audio. Must be either
+	 * 8000, 12000, 16000, 24000, or 48000.
+	 */
+	Decoder(size_t channels = 2, size_t rate = 48000);
+
+	/**
+	 * Creates a new Decoder instance for a stream with the given channel
+	 * mapping, e.g. as read from the id header. Streams with a mapping family
+	 * other than zero are decoded using the multistream decoder.
+	 *
+	 * @param channels is the number of channels the decoded audio should
+	 * have.
+	 * @param rate is the sample rate of the decoded audio.
+	 * @param mapping is the channel mapping of the stream.
+	 */
+	Decoder(size_t channels, size_t rate,
+	        const OggOpusMuxer::ChannelMapping &mapping);
+
+	/**
+	 * Destroys the Decoder instance.
+	 */
+	~Decoder();
+
+	/**
+	 * Maximum number of samples a single Opus packet (120ms) decodes to at
+	 * the given sample rate.
+	 */
+	static size_t max_packet_samples(size_t rate) { return (120 * rate) / 1000; }
+
+	/**
+	 * Number of channels passed to the constructor.
+	 */
+	size_t channels() const;
+
+	/**
+	 * Sample rate passed to the constructor.
+	 */
+	size_t rate() const;
+
+	/**
+	 * Decodes a single Opus packet. Throws an exception if the packet cannot
+	 * be decoded.
+	 *
+	 * @param data is a pointer at the packet data.
+	 * @param size is the size of the packet in bytes.
+	 * @param tar is the buffer the interleaved samples are written to.
+	 * @param n_tar is the capacity of the target buffer in multi-channel
+	 * samples. Should be at least max_packet_samples().
+	 * @return the number of multi-channel samples that have been decoded.
+	 */
+	size_t decode(const uint8_t *data, size_t size, float *tar, size_t n_tar);
+
+	/**
+	 * Resets the decoder state, e.g. after seeking within the stream.
+	 */
+	void reset();
+};
+}
+}
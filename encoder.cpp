@@ -21,12 +21,15 @@
 #include <exception>
 #include <iostream>
 #include <limits>
+#include <vector>
 
 #include <opus/opus.h>
+#include <opus/opus_multistream.h>
 
 #include "encoder.hpp"
 #include "lpc.hpp"
 #include "ogg_opus_muxer.hpp"
+#include "silence.hpp"
 
 namespace eolian {
 namespace stream {
@@ -100,34 +103,86 @@ public:
 
 /**
  * The OpusEncoderContainer class is a minimal object-oriented RAII wrapper
- * around the C opus_encoder API.
+ * around the C opus_encoder API. For more than two channels, the
+ * opus_multistream surround encoder is used instead, which codes the channels
+ * as multiple Opus streams (channel mapping family 1).
  */
 class OpusEncoderContainer {
 private:
 	/**
-	 * Private instance of the OpusEncoder.
+	 * Private instance of the OpusEncoder. Only used for one or two channels.
 	 */
-	mutable OpusEncoder *m_enc;
+	mutable OpusEncoder *m_enc = nullptr;
+
+	/**
+	 * Private instance of the OpusMSEncoder. Only used for more than two
+	 * channels.
+	 */
+	mutable OpusMSEncoder *m_ms_enc = nullptr;
+
+	/**
+	 * Channel mapping written to the id header.
+	 */
+	OggOpusMuxer::ChannelMapping m_mapping;
+
+	/**
+	 * Performs the given encoder control request. Throws an exception if the
+	 * request fails.
+	 */
+	void ctl(int request, opus_int32 value)
+	{
+		int err = m_ms_enc ? opus_multistream_encoder_ctl(m_ms_enc, request,
+		                                                  value)
+		                   : opus_encoder_ctl(m_enc, request, value);
+		if (err) {
+			throw OpusEncoderError(err);
+		}
+	}
 
 public:
+	/**
+	 * Maximum number of channels supported by channel mapping family 1.
+	 */
+	static constexpr size_t MAX_CHANNELS = 8;
+
 	/**
 	 * Creates a new OpusEncoderContainer instance.
 	 *
 	 * @param rate is the sample rate. Must be either 8000, 12000, 16000, 24000,
 	 * or 48000.
-	 * @param channels is the number of channels. Must be one or two.
+	 * @param channels is the number of channels in Vorbis channel order. Must
+	 * be between one and eight.
 	 * @param application is the coding mode that should be used.
 	 */
 	OpusEncoderContainer(int32_t rate = 48000, int channels = 2,
 	                     int application = OPUS_APPLICATION_AUDIO)
-	    : m_enc(nullptr)
 	{
 		// Instantiate a new opus encoder instance.
 		int err;
-		m_enc = opus_encoder_create(rate, channels, application, &err);
-		if (!m_enc || err) {
+		if (channels <= 2) {
+			m_enc = opus_encoder_create(rate, channels, application, &err);
+			if (!m_enc || err) {
+				throw OpusEncoderError(err);
+			}
+			return;
+		}
+
+		// Instantiate a surround encoder for more than two channels
+		if (size_t(channels) > MAX_CHANNELS) {
+			throw OpusEncoderError(
+			    "Encoder does not support more than eight channels");
+		}
+		int streams = 0, coupled_streams = 0;
+		m_mapping.family = 1;
+		m_mapping.mapping.resize(channels);
+		m_ms_enc = opus_multistream_surround_encoder_create(
+		    rate, channels, m_mapping.family, &streams, &coupled_streams,
+		    m_mapping.mapping.data(), application, &err);
+		if (!m_ms_enc || err) {
 			throw OpusEncoderError(err);
 		}
+		m_mapping.streams = streams;
+		m_mapping.coupled_streams = coupled_streams;
 	}
 
 	/**
@@ -139,19 +194,96 @@ public:
 			opus_encoder_destroy(m_enc);
 			m_enc = nullptr;
 		}
+		if (m_ms_enc) {
+			opus_multistream_encoder_destroy(m_ms_enc);
+			m_ms_enc = nullptr;
+		}
 	}
 
+	/**
+	 * Returns true if the multistream encoder is being used.
+	 */
+	bool multistream() const { return m_ms_enc != nullptr; }
+
+	/**
+	 * Returns the channel mapping that must be written to the id header.
+	 */
+	const OggOpusMuxer::ChannelMapping &mapping() const { return m_mapping; }
+
 	/**
 	 * Sets the desired bitrate.
 	 */
-	void bitrate(size_t bitrate)
+	void bitrate(size_t bitrate) { ctl(OPUS_SET_BITRATE(bitrate)); }
+
+	/**
+	 * Sets the computational complexity between zero and ten.
+	 */
+	void complexity(size_t complexity)
 	{
-		int err = opus_encoder_ctl(m_enc, OPUS_SET_BITRATE(bitrate));
-		if (err) {
-			throw OpusEncoderError(err);
+		ctl(OPUS_SET_COMPLEXITY(complexity));
+	}
+
+	/**
+	 * Sets the rate control mode.
+	 */
+	void vbr_mode(Encoder::VBRMode vbr_mode)
+	{
+		ctl(OPUS_SET_VBR(vbr_mode != Encoder::VBRMode::CBR));
+		ctl(OPUS_SET_VBR_CONSTRAINT(vbr_mode == Encoder::VBRMode::CVBR));
+	}
+
+	/**
+	 * Sets the signal type hint.
+	 */
+	void signal(Encoder::Signal signal)
+	{
+		switch (signal) {
+			case Encoder::Signal::AUTO:
+				ctl(OPUS_SET_SIGNAL(OPUS_AUTO));
+				break;
+			case Encoder::Signal::VOICE:
+				ctl(OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+				break;
+			case Encoder::Signal::MUSIC:
+				ctl(OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
+				break;
+		}
+	}
+
+	/**
+	 * Sets the maximum bandwidth the encoder may use.
+	 */
+	void max_bandwidth(Encoder::Bandwidth bandwidth)
+	{
+		switch (bandwidth) {
+			case Encoder::Bandwidth::NARROWBAND:
+				ctl(OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_NARROWBAND));
+				break;
+			case Encoder::Bandwidth::MEDIUMBAND:
+				ctl(OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_MEDIUMBAND));
+				break;
+			case Encoder::Bandwidth::WIDEBAND:
+				ctl(OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_WIDEBAND));
+				break;
+			case Encoder::Bandwidth::SUPERWIDEBAND:
+				ctl(OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_SUPERWIDEBAND));
+				break;
+			case Encoder::Bandwidth::FULLBAND:
+				ctl(OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_FULLBAND));
+				break;
 		}
 	}
 
+	/**
+	 * Sets the bit depth of the input signal.
+	 */
+	void lsb_depth(size_t lsb_depth) { ctl(OPUS_SET_LSB_DEPTH(lsb_depth)); }
+
+	/**
+	 * Enables or disables discontinuous transmission.
+	 */
+	void dtx(bool dtx) { ctl(OPUS_SET_DTX(dtx)); }
+
 	/**
 	 * Encodes the given floating point buffer as a single opus frame. Throws an
 	 * exception if an error happens during encoding, e.g. invalid frame size,
@@ -169,7 +301,10 @@ public:
 	              int32_t max_data_bytes)
 	{
 		const int res =
-		    opus_encode_float(m_enc, pcm, frame_size, data, max_data_bytes);
+		    m_ms_enc ? opus_multistream_encode_float(m_ms_enc, pcm, frame_size,
+		                                             data, max_data_bytes)
+		             : opus_encode_float(m_enc, pcm, frame_size, data,
+		                                 max_data_bytes);
 		if (res < 0) {
 			throw OpusEncoderError(res);
 		}
@@ -190,11 +325,97 @@ public:
 	size_t pre_skip() const
 	{
 		opus_int32 lookahead = 0;
-		opus_encoder_ctl(m_enc, OPUS_GET_LOOKAHEAD(&lookahead));
+		if (m_ms_enc) {
+			opus_multistream_encoder_ctl(m_ms_enc,
+			                             OPUS_GET_LOOKAHEAD(&lookahead));
+		}
+		else {
+			opus_encoder_ctl(m_enc, OPUS_GET_LOOKAHEAD(&lookahead));
+		}
 		return lookahead;
 	}
 };
 
+/******************************************************************************
+ * Class OpusRepacketizerContainer                                            *
+ ******************************************************************************/
+
+/**
+ * The OpusRepacketizerContainer class is a minimal object-oriented RAII wrapper
+ * around the C opus_repacketizer API.
+ */
+class OpusRepacketizerContainer {
+private:
+	/**
+	 * Private instance of the OpusRepacketizer.
+	 */
+	OpusRepacketizer *m_rp;
+
+public:
+	/**
+	 * Creates a new OpusRepacketizerContainer instance.
+	 */
+	OpusRepacketizerContainer() : m_rp(opus_repacketizer_create())
+	{
+		if (!m_rp) {
+			throw OpusEncoderError(OPUS_ALLOC_FAIL);
+		}
+	}
+
+	/**
+	 * Frees the contained OpusRepacketizer instance.
+	 */
+	~OpusRepacketizerContainer()
+	{
+		if (m_rp) {
+			opus_repacketizer_destroy(m_rp);
+			m_rp = nullptr;
+		}
+	}
+
+	/**
+	 * Removes all frames from the repacketizer.
+	 */
+	void reset() { opus_repacketizer_init(m_rp); }
+
+	/**
+	 * Returns the number of frames currently stored in the repacketizer.
+	 */
+	size_t n_frames() const { return opus_repacketizer_get_nb_frames(m_rp); }
+
+	/**
+	 * Adds a packet to the repacketizer. Note that the repacketizer does not
+	 * copy the packet data, the memory must stay valid until the next call to
+	 * reset(). Returns false if the packet is incompatible with the packets
+	 * already stored in the repacketizer or the total duration would exceed
+	 * 120ms.
+	 */
+	bool cat(const uint8_t *data, size_t len)
+	{
+		const int err = opus_repacketizer_cat(m_rp, data, len);
+		if (err == OPUS_INVALID_PACKET) {
+			return false;
+		}
+		else if (err) {
+			throw OpusEncoderError(err);
+		}
+		return true;
+	}
+
+	/**
+	 * Writes all stored frames as a single packet to the given buffer and
+	 * returns the size of the packet in bytes.
+	 */
+	size_t out(uint8_t *data, int32_t max_data_bytes)
+	{
+		const int32_t res = opus_repacketizer_out(m_rp, data, max_data_bytes);
+		if (res < 0) {
+			throw OpusEncoderError(res);
+		}
+		return res;
+	}
+};
+
 /******************************************************************************
  * Struct Enocder::Impl                                                       *
  ******************************************************************************/
@@ -214,39 +435,46 @@ struct Encoder::Impl {
 	static constexpr size_t LPC_ORDER = 24;
 
 	/**
-	 * Number of bytes in the buffer used for the Opus encoder. Size is chosen
-	 * such that 20ms of raw stero audio frames could be held in the buffer at
-	 * 48000. The Opus encoded audio should be smaller than that.
+	 * Number of bytes in the buffer used for the Opus encoder. This is the
+	 * maximum packet size recommended by the libopus documentation and
+	 * sufficient for a single frame of up to 60ms.
 	 */
-	static constexpr size_t ENC_BUF_SIZE = 4096;
+	static constexpr size_t ENC_BUF_SIZE = 4000;
 
 	/**
-	 * Number of floats in the temporary sample buffer. Corresponds to the
-	 * number
-	 * of floats in a 20ms frame at 48000 Hz rounded to the next power of two.
+	 * Buffer used for storing encoded Opus frame data.
 	 */
-	static constexpr size_t RAW_BUF_SIZE = 2048;
+	alignas(16) uint8_t enc_buf[ENC_BUF_SIZE];
 
 	/**
-	 * Number of floats in the LPC/lead-in/out buffer. The number of float is
-	 * chosen as twice the maximum window size rounded to the next power of two.
+	 * Buffer holding RAW sample data that was not used to fill an entire frame.
+	 * Holds exactly one frame.
 	 */
-	static constexpr size_t LPC_BUF_SIZE = 4096;
+	std::vector<float> buf;
 
 	/**
-	 * Buffer used for storing encoded Opus frame data.
+	 * Buffer used for storing lpc data, as well as lead in/lead out buffers.
+	 * Holds two frames.
 	 */
-	alignas(16) uint8_t enc_buf[ENC_BUF_SIZE];
+	std::vector<float> lpc_buf;
 
 	/**
-	 * Buffer holding RAW sample data that was not used to fill an entire frame.
+	 * Frame of digital silence encoded in place of silent frames. Only
+	 * allocated if the silence detection is enabled.
 	 */
-	alignas(16) float buf[RAW_BUF_SIZE];
+	std::vector<float> zero_buf;
 
 	/**
-	 * Buffer used for storing lpc data, as well as lead in/lead out buffers.
+	 * Real audio data preceding the stream. Used instead of the reverse LPC
+	 * when generating the lead-in frame. Holds at most one frame.
 	 */
-	alignas(16) float lpc_buf[LPC_BUF_SIZE];
+	std::vector<float> pre_roll_buf;
+
+	/**
+	 * Real audio data following the stream. Used instead of the LPC when
+	 * padding the final frames. Holds at most two frames.
+	 */
+	std::vector<float> post_roll_buf;
 
 	/**
 	 * Multiplier used to translate between granule/pre_skip values in samples
@@ -256,9 +484,9 @@ struct Encoder::Impl {
 	int granule_mul;
 
 	/**
-	 * LPC instances used for predictive coding.
+	 * LPC instances used for predictive coding, one for each channel.
 	 */
-	LinearPredictiveCoder lpc;
+	std::vector<LinearPredictiveCoder> lpc;
 
 	/**
 	 * Instance of the opus encoder.
@@ -271,16 +499,59 @@ struct Encoder::Impl {
 	 */
 	OggOpusMuxer muxer;
 
+	/**
+	 * Maximum number of frames merged into a single Opus packet.
+	 */
+	size_t packet_frames;
+
+	/**
+	 * Fixed size of each packet in bytes or zero if packets are not padded.
+	 */
+	size_t packet_size;
+
+	/**
+	 * Repacketizer used to merge multiple frames into a single packet. Only
+	 * used if packet_frames is larger than one.
+	 */
+	OpusRepacketizerContainer rp;
+
+	/**
+	 * Buffer holding the encoded frames that have been added to the
+	 * repacketizer, as well as the merged packet.
+	 */
+	std::vector<uint8_t> packet_buf;
+
+	/**
+	 * Number of bytes of encoded frames in the packet_buf.
+	 */
+	size_t packet_buf_ptr = 0;
+
+	/**
+	 * Granule position of the last frame added to the repacketizer.
+	 */
+	int64_t packet_granule = 0;
+
 	/**
 	 * Current element in any of the internal buffers.
 	 */
-	size_t buf_ptr = 0, lpc_buf_ptr = 0;
+	size_t buf_ptr = 0, lpc_buf_ptr = 0, post_roll_ptr = 0;
 
 	/**
 	 * Total sample count including the samples in the sample buffer.
 	 */
 	int64_t granule = 0;
 
+	/**
+	 * Number of samples in a single frame.
+	 */
+	size_t fs;
+
+	/**
+	 * Number of samples the LPC coefficients for the lead-in and lead-out
+	 * frames are extracted from.
+	 */
+	size_t lpc_fs;
+
 	/**
 	 * Number of samples that must be added to the end of the stream to account
 	 * for the latency (pre_skip in Ogg) of the Opus encoder.
@@ -297,65 +568,129 @@ struct Encoder::Impl {
 	 */
 	size_t rate = 0;
 
+	/**
+	 * Peak amplitude below which a frame is treated as silent or zero if the
+	 * silence detection is disabled.
+	 */
+	float silence_threshold = 0.0f;
+
 	/**
 	 * Current bitrate being used.
 	 */
 	size_t current_bitrate = 0;
 
+	/**
+	 * Current complexity being used.
+	 */
+	size_t current_complexity = 0;
+
 	/**
 	 * Flag indicating whether the first frame has been issued.
 	 */
 	bool first = true;
 
 	Impl(std::ostream &os, const Tags &tags, int64_t granule_offset,
-	     size_t channels, size_t rate)
-	    : granule_mul(48000 / rate),
-	      enc(rate, channels),
-	      muxer(os, granule_mul * (frame_size(rate) + enc.pre_skip()),
-	            enc.version_string(), tags, channels, rate),
+	     const Settings &settings)
+	    : buf(frame_size(settings.rate(), settings.frame_duration()) *
+	          settings.channels()),
+	      lpc_buf(2 * buf.size()),
+	      zero_buf(settings.silence_threshold() > 0.0f ? buf.size() : 0, 0.0f),
+	      granule_mul(48000 / settings.rate()),
+	      lpc(settings.channels()),
+	      enc(settings.rate(), settings.channels()),
+	      muxer(os,
+	            granule_mul *
+	                (frame_size(settings.rate(), settings.frame_duration()) +
+	                 enc.pre_skip()),
+	            enc.version_string(), tags, settings.channels(),
+	            settings.rate(), settings.headers(),
+	            settings.packets_per_page(), enc.mapping()),
+	      packet_frames(settings.packet_frames()),
+	      packet_size(settings.packet_size()),
+	      packet_buf(packet_frames > 1 ? 2 * packet_frames * ENC_BUF_SIZE : 0),
 	      granule(granule_offset),
+	      fs(frame_size(settings.rate(), settings.frame_duration())),
+	      lpc_fs(std::max(fs / 2, std::min(fs, 4 * LPC_ORDER))),
 	      final_padding(enc.pre_skip()),
-	      channels(channels),
-	      rate(rate)
+	      channels(settings.channels()),
+	      rate(settings.rate()),
+	      silence_threshold(settings.silence_threshold()),
+	      current_complexity(settings.complexity())
 	{
-		// Make sure there are at most two channels
-		if (channels > 2) {
+		// Multistream packets cannot be merged or padded using the
+		// single-stream repacketizer
+		if (enc.multistream() && (packet_frames > 1 || packet_size > 0)) {
 			throw OpusEncoderError(
-			    "Encoder does not support more than two channels");
+			    "Multiple frames per packet and fixed packet sizes are not "
+			    "supported for more than two channels");
+		}
+
+		// Make sure the frame duration is supported by Opus
+		if (fs == 0 || fs * 400 % rate != 0 || fs * 1000 > 60 * rate) {
+			throw OpusEncoderError("Invalid frame duration");
+		}
+		if (packet_frames * fs * 1000 > 120 * rate) {
+			throw OpusEncoderError("Opus packets may not exceed 120ms");
 		}
 
-		// Make sure all internal buffers are of sufficient size
-		assert(ENC_BUF_SIZE >= (frame_size() * channels * 2));
-		assert(RAW_BUF_SIZE >= (frame_size() * channels));
-		assert(LPC_BUF_SIZE >= (frame_size() * channels * 2));
+		// Apply the encoder tuning parameters
+		enc.complexity(current_complexity);
+		enc.vbr_mode(settings.vbr_mode());
+		enc.signal(settings.signal());
+		enc.max_bandwidth(settings.max_bandwidth());
+		enc.lsb_depth(settings.lsb_depth());
+		enc.dtx(settings.dtx());
 	}
 
 	~Impl()
 	{
-		// Encode any data that is still in the input buffer, append an extra
-		// frame if there was not enough space to allow the decoder to
-		// compensate for the pre_skip
-		const bool needs_extra_frame =
-		    (frame_size() - buf_ptr) < enc.pre_skip();
-		encode_frame(buf, buf_ptr, needs_extra_frame, !needs_extra_frame);
-		if (needs_extra_frame) {
-			encode_frame(nullptr, 0, false, true);
-		}
+		// Encode any data that is still in the input buffer, append extra
+		// frames until there was enough space to allow the decoder to
+		// compensate for the pre_skip. More than one extra frame is required
+		// if the frame size is smaller than the pre_skip.
+		const float *src = buf.data();
+		size_t n_src = buf_ptr;
+		do {
+			const bool flush = final_padding <= fs - n_src;
+			encode_frame(src, n_src, !flush, flush);
+			src = nullptr;
+			n_src = 0;
+		} while (final_padding > 0);
 	}
 
 	/**
-	 * Returns the number of samples in a frame given the specified rate. The
-	 * frame size is fixed to 20ms.
+	 * Returns the number of samples in a frame given the specified rate and
+	 * frame duration in milliseconds.
 	 */
-	static constexpr size_t frame_size(size_t rate)
+	static size_t frame_size(size_t rate, float frame_duration)
 	{
-		return (20 * rate) / 1000;
+		return size_t(frame_duration * rate) / 1000;
 	}
 
 	/**
 	 * Returns the number of samples in a frame.
 	 */
-	size_t frame_size() const { return frame_size(rate); }
+	size_t frame_size() const { return fs; }
+
+	/**
+	 * Stores the last frame of the given pre-roll data.
+	 */
+	void pre_roll(const float *src, size_t n_src)
+	{
+		const size_t n = std::min(n_src, frame_size());
+		src += (n_src - n) * channels;
+		pre_roll_buf.assign(src, src + n * channels);
+	}
+
+	/**
+	 * Stores the first two frames of the given post-roll data.
+	 */
+	void post_roll(const float *src, size_t n_src)
+	{
+		const size_t n = std::min(n_src, 2 * frame_size());
+		post_roll_buf.assign(src, src + n * channels);
+		post_roll_ptr = 0;
+	}
 
 	/**
 	 * Instructs the Opus encoder to use the given bitrate.
@@ -370,6 +705,31 @@ struct Encoder::Impl {
 		}
 	}
 
+	/**
+	 * Instructs the Opus encoder to use the given complexity.
+	 */
+	void complexity(size_t complexity)
+	{
+		if (complexity != current_complexity) {
+			enc.complexity(complexity);
+			current_complexity = complexity;
+		}
+	}
+
+	/**
+	 * Extracts the LPC coefficients of each channel from the n_src samples
+	 * in src and writes the n_tar predicted samples following them to tar.
+	 * Each channel has its own LinearPredictiveCoder instance, hence the
+	 * channels are independent of each other.
+	 */
+	void predict(const float *src, size_t n_src, float *tar, size_t n_tar)
+	{
+		for (size_t i = 0; i < channels; i++) {
+			lpc[i].extract_coefficients(src + i, n_src, channels);
+			lpc[i].predict(src + i, n_src, tar + i, n_tar, channels);
+		}
+	}
+
 	/**
 	 * Encodes a single Opus frame. Inserts either a lead-in or lead-out frame
 	 * depending on whether
@@ -389,17 +749,19 @@ struct Encoder::Impl {
 	void encode_frame(const float *src, size_t n_src, bool last_in_seq,
 	                  bool flush = false)
 	{
-		// Some shorthands
-		const size_t fs = frame_size();
-		const size_t lpc_fs = fs / 2;
-
 		// Make sure the input size is at most the framesize
 		assert(n_src <= fs);
 
 		// If this is the first frame that is ever being encoded, produce a
 		// lead-in frame. This frame leads up to the actual sample data and must
 		// be discarded by the decoder (along with the encoder lookahead).
-		if (first) {
+		if (first && pre_roll_buf.size() == fs * channels) {
+			// Real audio data preceding the stream is available, use it
+			// instead of a prediction
+			first = false;
+			encode_frame(pre_roll_buf.data(), fs, false);
+		}
+		else if (first) {
 			first = false;
 
 			// Copy the input data to a temporary buffer, reverse the buffer
@@ -407,20 +769,19 @@ struct Encoder::Impl {
 			// past)
 			size_t n_lpc_src = lpc_fs;
 			size_t n_lpc_tar = fs;
-			float *lpc_src = lpc_buf + lpc_fs * channels;
-			float *lpc_tar = lpc_buf + fs * channels;
-			float *lpc_buf_end = lpc_buf + 2 * fs * channels;
+			float *lpc_tar = lpc_buf.data() + fs * channels;
+			float *lpc_src = lpc_tar - n_lpc_src * channels;
+			float *lpc_buf_end = lpc_tar + fs * channels;
 
-			std::fill(lpc_buf, lpc_buf_end, 0.0f);
-			std::copy(src, src + n_src * channels, lpc_buf);
-			std::reverse(lpc_buf, lpc_buf + fs * channels);
+			std::fill(lpc_buf.data(), lpc_buf_end, 0.0f);
+			std::copy(src, src + n_src * channels, lpc_buf.data());
+			std::reverse(lpc_buf.data(), lpc_tar);
 
 			// Extract the LPC coefficients for the reversed buffer and create
-			// a prediction of the unkown past.
-			for (size_t i = 0; i < channels; i++) {
-				lpc.extract_coefficients(lpc_src + i, n_lpc_src, channels);
-				lpc.predict(lpc_src + i, n_lpc_src, lpc_tar + i, n_lpc_tar,
-				            channels);
+			// a prediction of the unkown past. If the source is silent, the
+			// prediction is silent as well; the buffer is already zeroed.
+			if (!is_silent(lpc_src, n_lpc_src * channels, silence_threshold)) {
+				predict(lpc_src, n_lpc_src, lpc_tar, n_lpc_tar);
 			}
 
 			// Reverse the prediction and encode it as frame
@@ -436,19 +797,30 @@ struct Encoder::Impl {
 		// to the granule.
 		if (n_src < fs) {
 			// Append the given input data to the current LPC buffer
-			float *lpc_new_data_src = lpc_buf + lpc_buf_ptr * channels;
+			float *lpc_new_data_src = lpc_buf.data() + lpc_buf_ptr * channels;
 			std::copy(src, src + n_src * channels, lpc_new_data_src);
 			lpc_buf_ptr += n_src;
 
-			// Predict how the data will continue using LPC
+			// Use the real post-roll data if there is enough of it left,
+			// otherwise predict how the data will continue using LPC
 			size_t n_lpc_src = std::min(lpc_fs, lpc_buf_ptr);
 			size_t n_lpc_tar = fs - n_src;
-			float *lpc_src = lpc_buf + (lpc_buf_ptr - n_lpc_src) * channels;
+			float *lpc_src =
+			    lpc_buf.data() + (lpc_buf_ptr - n_lpc_src) * channels;
 			float *lpc_tar = lpc_src + n_lpc_src * channels;
-			for (size_t i = 0; i < channels; i++) {
-				lpc.extract_coefficients(lpc_src + i, n_lpc_src, channels);
-				lpc.predict(lpc_src + i, n_lpc_src, lpc_tar + i, n_lpc_tar,
-				            channels);
+			if (post_roll_ptr + n_lpc_tar <= post_roll_buf.size() / channels) {
+				const float *post_roll_src =
+				    post_roll_buf.data() + post_roll_ptr * channels;
+				std::copy(post_roll_src, post_roll_src + n_lpc_tar * channels,
+				          lpc_tar);
+				post_roll_ptr += n_lpc_tar;
+			}
+			else if (is_silent(lpc_src, n_lpc_src * channels,
+			                   silence_threshold)) {
+				std::fill(lpc_tar, lpc_tar + n_lpc_tar * channels, 0.0f);
+			}
+			else {
+				predict(lpc_src, n_lpc_src, lpc_tar, n_lpc_tar);
 			}
 
 			// Make sure that pre_skip samples of the padding are actually
@@ -468,13 +840,86 @@ struct Encoder::Impl {
 			// LPC buffer to be able to extract the LPC coefficients in the case
 			// the stream ends with the next frame and padding information is
 			// required
-			std::copy(src, src + n_src * channels, lpc_buf);
+			std::copy(src, src + n_src * channels, lpc_buf.data());
 			lpc_buf_ptr = n_src;
 		}
 
+		// Replace silent frames by digital silence, which libopus encodes
+		// using only a few bytes
+		if (is_silent(src, fs * channels, silence_threshold)) {
+			src = zero_buf.data();
+		}
+
 		// Encode the frame and multiplex it into the output stream
+		if (packet_frames <= 1) {
+			size_t size = enc.encode(src, fs, enc_buf, ENC_BUF_SIZE);
+			size = pad_packet(enc_buf, size, ENC_BUF_SIZE);
+			muxer.write_frame(flush, granule * granule_mul, enc_buf, size);
+			return;
+		}
+
+		// Copy the encoded frame to the packet buffer and add it to the
+		// repacketizer. If the frame cannot be merged with the previous frames,
+		// write the pending packet and start a new one.
 		size_t size = enc.encode(src, fs, enc_buf, ENC_BUF_SIZE);
-		muxer.write_frame(flush, granule * granule_mul, enc_buf, size);
+		uint8_t *frame = packet_buf.data() + packet_buf_ptr;
+		std::copy(enc_buf, enc_buf + size, frame);
+		if (!rp.cat(frame, size)) {
+			write_packet(false);
+			frame = packet_buf.data();
+			std::copy(enc_buf, enc_buf + size, frame);
+			if (!rp.cat(frame, size)) {
+				throw OpusEncoderError("Cannot repacketize Opus frame");
+			}
+		}
+		packet_buf_ptr += size;
+		packet_granule = granule;
+
+		// Write the packet once it is full or the stream ends
+		if (flush || rp.n_frames() >= packet_frames) {
+			write_packet(flush);
+		}
+	}
+
+	/**
+	 * Pads the given packet to the fixed packet size if one has been
+	 * specified. Throws an exception if the packet is larger than the fixed
+	 * packet size. Returns the new size of the packet.
+	 */
+	size_t pad_packet(uint8_t *packet, size_t size, size_t max_size)
+	{
+		if (packet_size == 0) {
+			return size;
+		}
+		if (size > packet_size || packet_size > max_size) {
+			throw OpusEncoderError("Opus packet exceeds the fixed packet size");
+		}
+		const int err = opus_packet_pad(packet, size, packet_size);
+		if (err) {
+			throw OpusEncoderError(err);
+		}
+		return packet_size;
+	}
+
+	/**
+	 * Merges all frames in the repacketizer into a single Opus packet and
+	 * multiplexes it into the output stream.
+	 *
+	 * @param flush if set to true, the output stream will be marked as closed
+	 * after this packet.
+	 */
+	void write_packet(bool flush)
+	{
+		if (rp.n_frames() == 0) {
+			return;
+		}
+		uint8_t *packet = packet_buf.data() + packet_buf_ptr;
+		const size_t max_size = packet_buf.size() - packet_buf_ptr;
+		const size_t size =
+		    pad_packet(packet, rp.out(packet, max_size), max_size);
+		muxer.write_frame(flush, packet_granule * granule_mul, packet, size);
+		rp.reset();
+		packet_buf_ptr = 0;
 	}
 
 	/**
@@ -487,20 +932,20 @@ struct Encoder::Impl {
 	 */
 	void encode(const float *src, size_t n_src)
 	{
-		const size_t fs = frame_size();
 		while (n_src > 0) {
 			// Extract one frame of input data, either by directly encoding from
 			// the given source buffer or by filling the sample buffer.
 			const size_t n_read = std::min(fs - buf_ptr, n_src);
+			const bool last_in_seq = (n_src - n_read) < fs;
 			if (n_read == fs) {
-				encode_frame(src, fs, n_src < fs);
+				encode_frame(src, fs, last_in_seq);
 			}
 			else {
-				std::copy(src, src + n_src * channels,
-				          buf + buf_ptr * channels);
+				std::copy(src, src + n_read * channels,
+				          buf.data() + buf_ptr * channels);
 				buf_ptr += n_read;
 				if (buf_ptr == fs) {
-					encode_frame(buf, fs, n_src < fs);
+					encode_frame(buf.data(), fs, last_in_seq);
 					buf_ptr = 0;
 				}
 			}
@@ -521,7 +966,6 @@ struct Encoder::Impl {
 	 */
 	void encode(const int16_t *src, size_t n_src)
 	{
-		const size_t fs = frame_size();
 		while (n_src > 0) {
 			// Fill the internal input buffer with one frame of input data
 			const size_t n_read = std::min(fs - buf_ptr, n_src);
@@ -538,7 +982,7 @@ struct Encoder::Impl {
 
 			// If the internal buffer is full, encode the buffer as Opus frame
 			if (buf_ptr == fs) {
-				encode_frame(buf, fs, n_src < fs);
+				encode_frame(buf.data(), fs, n_src < fs);
 				buf_ptr = 0;
 			}
 		}
@@ -550,9 +994,35 @@ struct Encoder::Impl {
  ******************************************************************************/
 
 Encoder::Encoder(std::ostream &os, const Tags &tags, int64_t granule_offset,
-                 size_t channels, size_t rate)
-    : m_impl(std::make_unique<Impl>(os, tags, granule_offset, channels, rate))
+                 const Settings &settings)
+    : m_impl(std::make_unique<Impl>(os, tags, granule_offset, settings))
+{
+}
+
+void Encoder::write_headers(std::ostream &os, const Tags &tags,
+                            const Settings &settings)
+{
+	OpusEncoderContainer enc(settings.rate(), settings.channels());
+	const size_t granule_mul = 48000 / settings.rate();
+	OggOpusMuxer::write_headers(
+	    os,
+	    granule_mul * (Impl::frame_size(settings.rate(),
+	                                    settings.frame_duration()) +
+	                   enc.pre_skip()),
+	    enc.version_string(), tags, settings.channels(), settings.rate(),
+	    enc.mapping());
+}
+
+OggOpusMuxer::ChannelMapping Encoder::channel_mapping(const Settings &settings)
+{
+	return OpusEncoderContainer(settings.rate(), settings.channels())
+	    .mapping();
+}
+
+size_t Encoder::lookahead(const Settings &settings)
 {
+	return OpusEncoderContainer(settings.rate(), settings.channels())
+	    .pre_skip();
 }
 
 Encoder::~Encoder()
@@ -562,10 +1032,30 @@ Encoder::~Encoder()
 
 size_t Encoder::frame_size() const { return m_impl->frame_size(); }
 
+size_t Encoder::frame_size(size_t rate, float frame_duration)
+{
+	return Impl::frame_size(rate, frame_duration);
+}
+
+void Encoder::complexity(size_t complexity)
+{
+	m_impl->complexity(complexity);
+}
+
 size_t Encoder::pre_skip() const { return m_impl->enc.pre_skip(); }
 
 size_t Encoder::rate() const { return m_impl->rate; }
 
+void Encoder::pre_roll(const float *src, size_t n_src)
+{
+	m_impl->pre_roll(src, n_src);
+}
+
+void Encoder::post_roll(const float *src, size_t n_src)
+{
+	m_impl->post_roll(src, n_src);
+}
+
 void Encoder::encode(const float *src, size_t n_src, size_t bitrate)
 {
 	m_impl->bitrate(bitrate);
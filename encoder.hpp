@@ -34,8 +34,12 @@
 #include <cstdint>
 #include <iosfwd>
 #include <memory>
+#include <string>
+#include <tuple>
 #include <vector>
 
+#include "ogg_opus_muxer.hpp"
+
 namespace eolian {
 namespace stream {
 
@@ -60,6 +64,317 @@ public:
 	 */
 	using Tags = std::vector<std::tuple<std::string, std::string>>;
 
+	/**
+	 * Rate control modes supported by the Opus encoder.
+	 */
+	enum class VBRMode {
+		/**
+		 * Unconstrained variable bitrate. Default mode of libopus.
+		 */
+		VBR,
+
+		/**
+		 * Constrained variable bitrate, the bitrate fluctuates at most by
+		 * the size of the bit reservoir.
+		 */
+		CVBR,
+
+		/**
+		 * Constant bitrate, each frame has the same size.
+		 */
+		CBR
+	};
+
+	/**
+	 * Hint about the type of the audio signal being encoded.
+	 */
+	enum class Signal {
+		/**
+		 * Let the encoder decide based on its own signal analysis.
+		 */
+		AUTO,
+
+		/**
+		 * Bias the encoder towards speech coding (SILK) modes.
+		 */
+		VOICE,
+
+		/**
+		 * Bias the encoder towards music coding (CELT) modes.
+		 */
+		MUSIC
+	};
+
+	/**
+	 * Audio bandwidths supported by the Opus encoder.
+	 */
+	enum class Bandwidth {
+		NARROWBAND,    /**< 4 kHz passband */
+		MEDIUMBAND,    /**< 6 kHz passband */
+		WIDEBAND,      /**< 8 kHz passband */
+		SUPERWIDEBAND, /**< 12 kHz passband */
+		FULLBAND       /**< 20 kHz passband */
+	};
+
+	/**
+	 * The Settings class stores the parameters of the Encoder which must be
+	 * known when the stream header is written.
+	 */
+	class Settings {
+	private:
+		size_t m_channels = 2;
+		size_t m_rate = 48000;
+		bool m_headers = true;
+		size_t m_packet_frames = 1;
+		float m_frame_duration = 20.0f;
+		size_t m_complexity = 10;
+		VBRMode m_vbr_mode = VBRMode::VBR;
+		Signal m_signal = Signal::AUTO;
+		Bandwidth m_max_bandwidth = Bandwidth::FULLBAND;
+		size_t m_lsb_depth = 24;
+		size_t m_packet_size = 0;
+		size_t m_packets_per_page = 0;
+		bool m_dtx = false;
+		float m_silence_threshold = 0.0f;
+
+	public:
+		/**
+		 * Default constructor of the Settings class.
+		 */
+		Settings() {}
+
+		/**
+		 * Returns the number of channels that are interleaved in the input
+		 * data. Default value is two.
+		 */
+		size_t channels() const { return m_channels; }
+
+		/**
+		 * Sets the number of channels that are interleaved in the input data.
+		 * This must be between one and eight. Up to two channels are coded as
+		 * a single Opus stream; more channels are coded as multiple streams
+		 * using channel mapping family 1 and must be in Vorbis channel order
+		 * (e.g. L, C, R, RL, RR, LFE for 5.1). Multiple frames per packet and
+		 * fixed packet sizes are only supported for up to two channels.
+		 */
+		Settings &channels(size_t channels)
+		{
+			m_channels = channels;
+			return *this;
+		}
+
+		/**
+		 * Returns the sample rate. Default value is 48000.
+		 */
+		size_t rate() const { return m_rate; }
+
+		/**
+		 * Sets the sample rate, valid values are 8000, 12000, 16000, 24000 or
+		 * 48000, where the latter should always be used for music encoding.
+		 */
+		Settings &rate(size_t rate)
+		{
+			m_rate = rate;
+			return *this;
+		}
+
+		/**
+		 * Returns true if the id and comment headers are written to the
+		 * output stream. Default value is true.
+		 */
+		bool headers() const { return m_headers; }
+
+		/**
+		 * If set to false, the id and comment headers are not written to the
+		 * output stream. The headers can be written separately using
+		 * Encoder::write_headers().
+		 */
+		Settings &headers(bool headers)
+		{
+			m_headers = headers;
+			return *this;
+		}
+
+		/**
+		 * Returns the maximum number of frames merged into a single Opus
+		 * packet. Default value is one.
+		 */
+		size_t packet_frames() const { return m_packet_frames; }
+
+		/**
+		 * Sets the maximum number of consecutive frames that are merged into
+		 * a single Opus packet before being written to the Ogg stream. This
+		 * reduces the Ogg lacing and Opus TOC overhead. The total duration of
+		 * a packet may not exceed 120ms.
+		 */
+		Settings &packet_frames(size_t packet_frames)
+		{
+			m_packet_frames = packet_frames;
+			return *this;
+		}
+
+		/**
+		 * Returns the duration of a single Opus frame in milliseconds. Default
+		 * value is 20ms, as recommended by the libopus documentation.
+		 */
+		float frame_duration() const { return m_frame_duration; }
+
+		/**
+		 * Sets the duration of a single Opus frame in milliseconds. Valid
+		 * values are 2.5, 5, 10, 20, 40 and 60.
+		 */
+		Settings &frame_duration(float frame_duration)
+		{
+			m_frame_duration = frame_duration;
+			return *this;
+		}
+
+		/**
+		 * Returns the computational complexity of the encoder. Default value
+		 * is ten.
+		 */
+		size_t complexity() const { return m_complexity; }
+
+		/**
+		 * Sets the computational complexity of the encoder between zero and
+		 * ten. Lower values increase the encoding speed at the cost of
+		 * quality.
+		 */
+		Settings &complexity(size_t complexity)
+		{
+			m_complexity = complexity;
+			return *this;
+		}
+
+		/**
+		 * Returns the rate control mode. Default value is VBRMode::VBR.
+		 */
+		VBRMode vbr_mode() const { return m_vbr_mode; }
+
+		/**
+		 * Sets the rate control mode.
+		 */
+		Settings &vbr_mode(VBRMode vbr_mode)
+		{
+			m_vbr_mode = vbr_mode;
+			return *this;
+		}
+
+		/**
+		 * Returns the signal type hint. Default value is Signal::AUTO.
+		 */
+		Signal signal() const { return m_signal; }
+
+		/**
+		 * Sets the signal type hint passed to the encoder.
+		 */
+		Settings &signal(Signal signal)
+		{
+			m_signal = signal;
+			return *this;
+		}
+
+		/**
+		 * Returns the maximum bandwidth the encoder may use. Default value is
+		 * Bandwidth::FULLBAND.
+		 */
+		Bandwidth max_bandwidth() const { return m_max_bandwidth; }
+
+		/**
+		 * Sets the maximum bandwidth the encoder may use.
+		 */
+		Settings &max_bandwidth(Bandwidth max_bandwidth)
+		{
+			m_max_bandwidth = max_bandwidth;
+			return *this;
+		}
+
+		/**
+		 * Returns the bit depth of the input signal. Default value is 24.
+		 */
+		size_t lsb_depth() const { return m_lsb_depth; }
+
+		/**
+		 * Sets the bit depth of the input signal between 8 and 24. The
+		 * encoder treats signal components below the least significant bit
+		 * as noise it does not have to preserve.
+		 */
+		Settings &lsb_depth(size_t lsb_depth)
+		{
+			m_lsb_depth = lsb_depth;
+			return *this;
+		}
+
+		/**
+		 * Returns the fixed size of each Opus packet in bytes or zero if the
+		 * packet size is not fixed. Default value is zero.
+		 */
+		size_t packet_size() const { return m_packet_size; }
+
+		/**
+		 * If non-zero, each Opus packet is padded to exactly this many bytes.
+		 * Encoding fails if a packet is larger. Should be combined with
+		 * VBRMode::CBR.
+		 */
+		Settings &packet_size(size_t packet_size)
+		{
+			m_packet_size = packet_size;
+			return *this;
+		}
+
+		/**
+		 * Returns the number of packets after which an Ogg page is flushed or
+		 * zero if pages are filled up. Default value is zero.
+		 */
+		size_t packets_per_page() const { return m_packets_per_page; }
+
+		/**
+		 * If non-zero, each Ogg page contains exactly this many packets
+		 * (except for the last page).
+		 */
+		Settings &packets_per_page(size_t packets_per_page)
+		{
+			m_packets_per_page = packets_per_page;
+			return *this;
+		}
+
+		/**
+		 * Returns true if discontinuous transmission is enabled. Default
+		 * value is false.
+		 */
+		bool dtx() const { return m_dtx; }
+
+		/**
+		 * Enables discontinuous transmission. The encoder emits packets
+		 * without audio data during silence, which the decoder replaces by
+		 * comfort noise instead of exact digital silence.
+		 */
+		Settings &dtx(bool dtx)
+		{
+			m_dtx = dtx;
+			return *this;
+		}
+
+		/**
+		 * Returns the peak amplitude below which a frame is treated as
+		 * digital silence or zero if silence detection is disabled. Default
+		 * value is zero.
+		 */
+		float silence_threshold() const { return m_silence_threshold; }
+
+		/**
+		 * If non-zero, frames with a peak amplitude below the threshold are
+		 * replaced by digital silence, which libopus encodes as minimal
+		 * packets, and no linear prediction is performed for silent lead-in
+		 * and lead-out frames.
+		 */
+		Settings &silence_threshold(float silence_threshold)
+		{
+			m_silence_threshold = silence_threshold;
+			return *this;
+		}
+	};
+
 	/**
 	 * Creates a new encoder instance and writes the stream header to the given
 	 * output stream. Throws an exception if for some reason the encoder cannot
@@ -71,16 +386,25 @@ public:
 	 * the opus stream head.
 	 * @param granule_offset is the offset of the first sample in the stream
 	 * within a chain of streams.
-	 * @param channels is the number of channels that are interleaved in the
-	 * input data. This must either be one or two. More than two channels are
-	 * currently not supported.
-	 * @param rate is the sample rate, valid values are 8000, 12000, 16000,
-	 * 24000 or 48000, where the latter should always be used for music
-	 * encoding.
+	 * @param settings contains the number of channels, the sample rate and
+	 * whether the stream headers should be written.
 	 */
 	Encoder(std::ostream &os, const Tags &tags = Tags(),
-	        int64_t granule_offset = 0, size_t channels = 2,
-	        size_t rate = 48000);
+	        int64_t granule_offset = 0, const Settings &settings = Settings());
+
+	/**
+	 * Writes only the id and comment headers an Encoder instance with the
+	 * given settings would produce to the given output stream. Prepending
+	 * these headers to the output of an Encoder with Settings::headers() set
+	 * to false yields a valid Ogg/Opus stream.
+	 *
+	 * @param os is the output stream to which the headers should be written.
+	 * @param comments is a list of key/value pairs that should be written to
+	 * the opus stream head.
+	 * @param settings contains the number of channels and the sample rate.
+	 */
+	static void write_headers(std::ostream &os, const Tags &tags = Tags(),
+	                          const Settings &settings = Settings());
 
 	/**
 	 * Finalises the OGG/Opus stream. Encodes all pending opus frames and
@@ -89,12 +413,37 @@ public:
 	~Encoder();
 
 	/**
-	 * Number of samples constituting a single Opus frame. The Encoder class
-	 * is hardcoded to produced 20ms frames, just as the libpus documentation
-	 * recommends.
+	 * Number of samples constituting a single Opus frame. The frame duration
+	 * is set using Settings::frame_duration() and defaults to 20ms, just as
+	 * the libopus documentation recommends.
 	 */
 	size_t frame_size() const;
 
+	/**
+	 * Number of samples constituting a single Opus frame at the given sample
+	 * rate and frame duration in milliseconds.
+	 */
+	static size_t frame_size(size_t rate, float frame_duration = 20.0f);
+
+	/**
+	 * Changes the computational complexity of the encoder between zero and
+	 * ten. Only affects frames that are encoded after this call.
+	 */
+	void complexity(size_t complexity);
+
+	/**
+	 * Number of samples of latency of the Opus codec an Encoder instance with
+	 * the given settings would have.
+	 */
+	static size_t lookahead(const Settings &settings = Settings());
+
+	/**
+	 * Channel mapping written to the id header by an Encoder instance with
+	 * the given settings.
+	 */
+	static OggOpusMuxer::ChannelMapping channel_mapping(
+	    const Settings &settings = Settings());
+
 	/**
 	 * Number of samples of latency (pre_skip) of the Opus codec. This many
 	 * samples must be discarded from the decoded stream.
@@ -106,6 +455,28 @@ public:
 	 */
 	size_t rate() const;
 
+	/**
+	 * Provides real audio data immediately preceding the encoded stream. If at
+	 * least frame_size() samples are given, the lead-in frame consists of the
+	 * last frame of this data instead of being synthesised using linear
+	 * predictive coding. Must be called before the first call to encode().
+	 *
+	 * @param src is a pointer at the interleaved pre-roll audio data.
+	 * @param n_src is the number of multi-channel samples in the buffer.
+	 */
+	void pre_roll(const float *src, size_t n_src);
+
+	/**
+	 * Provides real audio data immediately following the encoded stream. This
+	 * data is used to pad the final frames instead of a linear prediction as
+	 * long as enough samples are available. At most 2 * frame_size() samples
+	 * are used.
+	 *
+	 * @param src is a pointer at the interleaved post-roll audio data.
+	 * @param n_src is the number of multi-channel samples in the buffer.
+	 */
+	void post_roll(const float *src, size_t n_src);
+
 	/**
 	 * Encodes a chunk of floating point audio data. The number of bytes that is
 	 * being read from the input buffer is
@@ -70,8 +70,8 @@ struct Scale {
  *********************************************************************/
 
 template <typename T>
-static void lpc_coefficients_from_data(float *lpcf, const T *src, size_t n_src,
-                                       size_t stride)
+static double lpc_coefficients_from_data(float *lpcf, const T *src,
+                                         size_t n_src, size_t stride)
 {
 	constexpr size_t order = LinearPredictiveCoder::order();
 	alignas(16) double lpc[order];
@@ -154,6 +154,9 @@ done:
 			damp *= g;
 		}
 	}
+
+	// Return the remaining prediction error
+	return error;
 }
 
 /******************************************************************************
@@ -164,14 +167,16 @@ void LinearPredictiveCoder::extract_coefficients(const float *samples,
                                                  size_t n_samples,
                                                  size_t stride)
 {
-	lpc_coefficients_from_data(m_coeffs, samples, n_samples, stride);
+	m_residual_energy =
+	    lpc_coefficients_from_data(m_coeffs, samples, n_samples, stride);
 }
 
 void LinearPredictiveCoder::extract_coefficients(const int16_t *samples,
                                                  size_t n_samples,
                                                  size_t stride)
 {
-	lpc_coefficients_from_data(m_coeffs, samples, n_samples, stride);
+	m_residual_energy =
+	    lpc_coefficients_from_data(m_coeffs, samples, n_samples, stride);
 }
 
 template <typename T>
@@ -51,6 +51,12 @@ private:
 	 */
 	alignas(16) float m_coeffs[LPC_ORDER];
 
+	/**
+	 * Energy of the prediction residual of the last call to
+	 * extract_coefficients().
+	 */
+	double m_residual_energy = 0.0;
+
 	template <typename T>
 	void predict_impl(const T *src_samples, size_t n_src_samples,
 	                  T *tar_samples, size_t n_tar_samples,
@@ -69,6 +75,14 @@ public:
 	 */
 	static constexpr size_t order() { return LPC_ORDER; }
 
+	/**
+	 * Returns the energy of the prediction residual, i.e. the part of the
+	 * signal energy that cannot be predicted by the filter, summed over all
+	 * samples passed to the last call to extract_coefficients(). Samples are
+	 * scaled to the range [-1, 1].
+	 */
+	double residual_energy() const { return m_residual_energy; }
+
 	/**
 	 * Extracts the LPC coefficients from a chunk of audio data represented as
 	 * floating point numbers.
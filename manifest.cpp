@@ -0,0 +1,164 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "manifest.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * Returns the passband of the given Opus bandwidth in Hz.
+ */
+static size_t passband(Encoder::Bandwidth bandwidth)
+{
+	switch (bandwidth) {
+		case Encoder::Bandwidth::NARROWBAND:
+			return 4000;
+		case Encoder::Bandwidth::MEDIUMBAND:
+			return 6000;
+		case Encoder::Bandwidth::WIDEBAND:
+			return 8000;
+		case Encoder::Bandwidth::SUPERWIDEBAND:
+			return 12000;
+		case Encoder::Bandwidth::FULLBAND:
+			break;
+	}
+	return 20000;
+}
+
+/**
+ * Writes the given string as a quoted JSON string.
+ */
+static void write_json_string(std::ostream &os, const std::string &str)
+{
+	os << '"';
+	for (const char c : str) {
+		if (c == '"' || c == '\\') {
+			os << '\\' << c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20) {
+			os << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+			   << int(c) << std::dec << std::setfill(' ');
+		}
+		else {
+			os << c;
+		}
+	}
+	os << '"';
+}
+
+/******************************************************************************
+ * Class Manifest                                                             *
+ ******************************************************************************/
+
+void Manifest::write_json(std::ostream &os) const
+{
+	os << "{\n"
+	   << "\t\"rate\": " << m_settings.rate() << ",\n"
+	   << "\t\"channels\": " << m_settings.channels() << ",\n"
+	   << "\t\"bitrate\": " << m_settings.bitrate() << ",\n"
+	   << "\t\"overlap\": " << m_settings.overlap_samples() << ",\n"
+	   << "\t\"length\": " << m_settings.length_samples() << ",\n"
+	   << "\t\"schedule\": [";
+	for (size_t i = 0; i < m_settings.schedule().size(); i++) {
+		os << ((i == 0) ? "" : ", ")
+		   << size_t(m_settings.schedule()[i] * m_settings.rate());
+	}
+	os << "],\n"
+	   << "\t\"seek_interval\": " << m_settings.seek_interval_samples()
+	   << ",\n";
+	if (m_settings.dedup()) {
+		size_t n_duplicates = 0;
+		for (const ChunkTranscoder::Chunk &chunk : m_chunks) {
+			n_duplicates += chunk.duplicate;
+		}
+		os << "\t\"dedup_ratio\": "
+		   << (m_chunks.empty() ? 0.0f
+		                        : float(n_duplicates) / m_chunks.size())
+		   << ",\n";
+	}
+	if (!m_tracks.empty()) {
+		// Convert the track positions to the sample rate of the chunks and
+		// to Ogg granule positions
+		const size_t rate = m_settings.rate();
+		const size_t input_rate =
+		    m_settings.input_rate() ? m_settings.input_rate() : rate;
+		auto convert = [&](size_t offs) {
+			return (uint64_t(offs) * rate + input_rate / 2) / input_rate;
+		};
+		os << "\t\"tracks\": [";
+		for (size_t i = 0; i < m_tracks.size(); i++) {
+			const Playlist::Track &track = m_tracks[i];
+			const size_t offs = convert(track.offs);
+			const size_t length = convert(track.offs + track.length) - offs;
+			os << ((i == 0) ? "\n" : ",\n") << "\t\t{"
+			   << "\"idx\": " << i << ", "
+			   << "\"name\": ";
+			write_json_string(os, track.name);
+			os << ", \"offs\": " << offs << ", "
+			   << "\"length\": " << length << ", "
+			   << "\"granule\": " << offs * (48000 / rate) << "}";
+		}
+		os << "\n\t],\n";
+	}
+	os << "\t\"chunks\": [";
+	for (size_t i = 0; i < m_chunks.size(); i++) {
+		const ChunkTranscoder::Chunk &chunk = m_chunks[i];
+		os << ((i == 0) ? "\n" : ",\n") << "\t\t{"
+		   << "\"idx\": " << chunk.idx << ", "
+		   << "\"offs\": " << chunk.offs << ", "
+		   << "\"length\": " << chunk.length << ", "
+		   << "\"cf_in\": " << chunk.crossfade_in << ", "
+		   << "\"cf_out\": " << chunk.crossfade_out;
+		if (m_settings.target_rtf() > 0.0f) {
+			os << ", \"complexity\": " << chunk.complexity << ", "
+			   << "\"rtf\": " << chunk.rtf;
+		}
+		if (m_settings.per_chunk_bitrate()) {
+			os << ", \"bitrate\": " << chunk.bitrate;
+		}
+		if (m_settings.target_snr() > 0.0f) {
+			os << ", \"snr\": " << chunk.snr;
+		}
+		if (m_settings.auto_signal()) {
+			os << ", \"signal\": "
+			   << ((chunk.signal == Encoder::Signal::VOICE) ? "\"speech\""
+			                                                : "\"music\"");
+		}
+		if (m_settings.silence_threshold() > 0.0f) {
+			os << ", \"silent\": " << (chunk.silent ? "true" : "false");
+		}
+		if (m_settings.dual_mono_threshold() > 0.0f) {
+			os << ", \"channels\": " << chunk.channels;
+		}
+		if (m_settings.dedup()) {
+			os << ", \"duplicate\": " << (chunk.duplicate ? "true" : "false");
+		}
+		if (m_settings.auto_bandwidth()) {
+			os << ", \"bandwidth\": " << passband(chunk.bandwidth);
+		}
+		os << "}";
+	}
+	os << "\n\t]\n}\n";
+}
+}
+}
@@ -0,0 +1,123 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file manifest.hpp
+ *
+ * Declares the Manifest class which collects the metadata of all chunks
+ * produced by a ChunkTranscoder and serialises it as JSON. This allows clients
+ * to locate chunks without having to parse the individual Ogg/Opus files.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <iosfwd>
+#include <vector>
+
+#include "chunk_transcoder.hpp"
+#include "playlist.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The Manifest class stores the settings of a ChunkTranscoder along with the
+ * position, length and crossfade metadata of each chunk.
+ */
+class Manifest {
+private:
+	/**
+	 * Settings the chunks were encoded with.
+	 */
+	ChunkTranscoder::Settings m_settings;
+
+	/**
+	 * Metadata of the individual chunks.
+	 */
+	std::vector<ChunkTranscoder::Chunk> m_chunks;
+
+	/**
+	 * Position of the individual tracks if the chunks were produced from a
+	 * Playlist.
+	 */
+	std::vector<Playlist::Track> m_tracks;
+
+public:
+	/**
+	 * Creates a new, empty Manifest instance.
+	 *
+	 * @param settings are the settings used by the ChunkTranscoder.
+	 */
+	Manifest(const ChunkTranscoder::Settings &settings =
+	             ChunkTranscoder::Settings())
+	    : m_settings(settings)
+	{
+	}
+
+	/**
+	 * Appends the metadata of a chunk to the manifest.
+	 *
+	 * @param chunk is the chunk descriptor as returned by
+	 * ChunkTranscoder::last_chunk().
+	 */
+	void push_back(const ChunkTranscoder::Chunk &chunk)
+	{
+		m_chunks.push_back(chunk);
+	}
+
+	/**
+	 * Returns the metadata of all chunks in the manifest.
+	 */
+	const std::vector<ChunkTranscoder::Chunk> &chunks() const
+	{
+		return m_chunks;
+	}
+
+	/**
+	 * Sets the tracks the continuous stream consists of.
+	 *
+	 * @param tracks is the list of tracks as returned by Playlist::tracks()
+	 * after the entire playlist has been transcoded. Track offsets and
+	 * lengths are measured at Settings::input_rate().
+	 */
+	void tracks(const std::vector<Playlist::Track> &tracks)
+	{
+		m_tracks = tracks;
+	}
+
+	/**
+	 * Returns the tracks stored in the manifest.
+	 */
+	const std::vector<Playlist::Track> &tracks() const { return m_tracks; }
+
+	/**
+	 * Returns the settings stored in the manifest.
+	 */
+	const ChunkTranscoder::Settings &settings() const { return m_settings; }
+
+	/**
+	 * Writes the manifest as JSON object to the given output stream. All
+	 * offsets and lengths are given in samples.
+	 *
+	 * @param os is the output stream the manifest should be written to.
+	 */
+	void write_json(std::ostream &os) const;
+};
+}
+}
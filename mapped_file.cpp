@@ -0,0 +1,86 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The MappedFileError class is used to signal that a file cannot be opened or
+ * mapped.
+ */
+class MappedFileError : public std::runtime_error {
+public:
+	MappedFileError(const std::string &filename)
+	    : std::runtime_error(filename + ": " + strerror(errno))
+	{
+	}
+};
+
+/******************************************************************************
+ * Class MappedFile                                                           *
+ ******************************************************************************/
+
+MappedFile::MappedFile(const std::string &filename)
+{
+	m_fd = open(filename.c_str(), O_RDONLY);
+	if (m_fd < 0) {
+		throw MappedFileError(filename);
+	}
+	struct stat st;
+	if (fstat(m_fd, &st) != 0) {
+		const MappedFileError err(filename);
+		unmap();
+		throw err;
+	}
+	m_size = st.st_size;
+	if (m_size > 0) {
+		void *ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+		if (ptr == MAP_FAILED) {
+			const MappedFileError err(filename);
+			unmap();
+			throw err;
+		}
+		m_data = static_cast<const uint8_t *>(ptr);
+	}
+}
+
+MappedFile::~MappedFile() { unmap(); }
+
+void MappedFile::unmap()
+{
+	if (m_data) {
+		munmap(const_cast<uint8_t *>(m_data), m_size);
+		m_data = nullptr;
+	}
+	if (m_fd >= 0) {
+		close(m_fd);
+		m_fd = -1;
+	}
+}
+}
+}
@@ -0,0 +1,76 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file mapped_file.hpp
+ *
+ * Declares the MappedFile class which maps a file read-only into memory.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace eolian {
+namespace stream {
+/**
+ * The MappedFile class maps an entire file read-only into memory, which allows
+ * random access to the file without copying its contents. The file is
+ * unmapped when the instance is destroyed.
+ */
+class MappedFile {
+private:
+	int m_fd = -1;
+	const uint8_t *m_data = nullptr;
+	size_t m_size = 0;
+
+	void unmap();
+
+public:
+	/**
+	 * Opens and maps the given file. Throws an exception if the file cannot
+	 * be opened or mapped.
+	 *
+	 * @param filename is the name of the file that should be mapped.
+	 */
+	explicit MappedFile(const std::string &filename);
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	/**
+	 * Unmaps and closes the file.
+	 */
+	~MappedFile();
+
+	/**
+	 * Returns a pointer at the file contents. Null for empty files.
+	 */
+	const uint8_t *data() const { return m_data; }
+
+	/**
+	 * Returns the size of the file in bytes.
+	 */
+	size_t size() const { return m_size; }
+};
+}
+}
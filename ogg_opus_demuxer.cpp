@@ -0,0 +1,358 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "ogg_opus_demuxer.hpp"
+
+namespace eolian {
+namespace stream {
+
+/******************************************************************************
+ * Class OggOpusDemuxerError                                                  *
+ ******************************************************************************/
+
+/**
+ * Exception thrown if the Ogg/Opus stream cannot be parsed.
+ */
+class OggOpusDemuxerError : public std::runtime_error {
+public:
+	OggOpusDemuxerError(const char *msg) : std::runtime_error(msg) {}
+};
+
+/******************************************************************************
+ * Class OggOpusDemuxer::Impl                                                 *
+ ******************************************************************************/
+
+static constexpr size_t PAGE_HEADER_SIZE = 27;
+static constexpr uint8_t HEADER_TYPE_CONTINUED = 0x01;
+static constexpr uint8_t HEADER_TYPE_LAST = 0x04;
+
+/**
+ * Actual implementation of the OggOpusDemuxer. Walks through the segment
+ * tables of the individual pages and assembles the packets.
+ */
+class OggOpusDemuxer::Impl {
+private:
+	const uint8_t *m_data;
+	size_t m_size;
+
+	/**
+	 * Offset of the next page in the buffer.
+	 */
+	size_t m_next_page = 0;
+
+	/**
+	 * Properties of the current page.
+	 */
+	const uint8_t *m_lacing = nullptr;
+	const uint8_t *m_body = nullptr;
+	size_t m_n_segments = 0;
+	size_t m_segment = 0;
+	size_t m_body_cursor = 0;
+	uint8_t m_header_type = 0;
+	int64_t m_granule = -1;
+
+	/**
+	 * Serial number of the logical stream and sequence number of the last
+	 * page. Used to detect interleaved streams and lost pages.
+	 */
+	uint32_t m_serial = 0;
+	uint32_t m_sequence = 0;
+	bool m_has_page = false;
+
+	/**
+	 * Buffer used to assemble packets spanning multiple pages.
+	 */
+	std::vector<uint8_t> m_buf;
+
+	bool m_has_headers = false;
+	size_t m_channels = 0;
+	size_t m_pre_skip = 0;
+	size_t m_rate = 0;
+	OggOpusMuxer::ChannelMapping m_mapping;
+	std::string m_vendor;
+	Tags m_tags;
+
+	static uint16_t read_u16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+	static uint32_t read_u32(const uint8_t *p)
+	{
+		return uint32_t(read_u16(p)) | (uint32_t(read_u16(p + 2)) << 16);
+	}
+
+	static int64_t read_i64(const uint8_t *p)
+	{
+		return int64_t(uint64_t(read_u32(p)) |
+		               (uint64_t(read_u32(p + 4)) << 32));
+	}
+
+	/**
+	 * Advances to the next page. Returns false if the end of the buffer has
+	 * been reached.
+	 */
+	bool next_page()
+	{
+		if (m_next_page >= m_size) {
+			return false;
+		}
+		const uint8_t *p = m_data + m_next_page;
+		const size_t avail = m_size - m_next_page;
+		if (avail < PAGE_HEADER_SIZE || memcmp(p, "OggS", 4) != 0 ||
+		    p[4] != 0) {
+			throw OggOpusDemuxerError("Invalid Ogg page header");
+		}
+		m_header_type = p[5];
+		m_granule = read_i64(p + 6);
+		m_n_segments = p[26];
+		if (avail < PAGE_HEADER_SIZE + m_n_segments) {
+			throw OggOpusDemuxerError("Truncated Ogg page");
+		}
+		m_lacing = p + PAGE_HEADER_SIZE;
+		size_t body_size = 0;
+		for (size_t i = 0; i < m_n_segments; i++) {
+			body_size += m_lacing[i];
+		}
+		if (avail < PAGE_HEADER_SIZE + m_n_segments + body_size) {
+			throw OggOpusDemuxerError("Truncated Ogg page");
+		}
+
+		// Verify the page checksum, which is computed with the checksum field
+		// set to zero
+		static const uint8_t zero[4] = {0, 0, 0, 0};
+		uint32_t crc = 0;
+		crc_update(crc, p, 22);
+		crc_update(crc, zero, 4);
+		crc_update(crc, p + 26, 1 + m_n_segments + body_size);
+		if (crc != read_u32(p + 22)) {
+			throw OggOpusDemuxerError("Ogg page checksum mismatch");
+		}
+
+		// All pages must belong to the same logical stream and must be
+		// numbered consecutively
+		const uint32_t serial = read_u32(p + 14);
+		const uint32_t sequence = read_u32(p + 18);
+		if (m_has_page && serial != m_serial) {
+			throw OggOpusDemuxerError("Multiple logical Ogg streams");
+		}
+		if (m_has_page && sequence != m_sequence + 1) {
+			throw OggOpusDemuxerError("Missing Ogg page");
+		}
+		m_serial = serial;
+		m_sequence = sequence;
+		m_has_page = true;
+		m_body = m_lacing + m_n_segments;
+		m_segment = 0;
+		m_body_cursor = 0;
+		m_next_page += PAGE_HEADER_SIZE + m_n_segments + body_size;
+		return true;
+	}
+
+	void parse_id_header(const Packet &packet)
+	{
+		// Versions with the same major version (upper four bits) are
+		// backwards compatible, see RFC 7845, Section 5.1
+		if (packet.size < 19 || (packet.data[8] & 0xF0) != 0) {
+			throw OggOpusDemuxerError("Invalid Opus id header");
+		}
+		m_channels = packet.data[9];
+		m_pre_skip = read_u16(packet.data + 10);
+		m_rate = read_u32(packet.data + 12);
+
+		// Read the channel mapping table for mapping families other than
+		// zero
+		m_mapping = OggOpusMuxer::ChannelMapping();
+		m_mapping.family = packet.data[18];
+		if (m_mapping.family != 0) {
+			if (packet.size < 21 + m_channels) {
+				throw OggOpusDemuxerError("Invalid Opus channel mapping");
+			}
+			m_mapping.streams = packet.data[19];
+			m_mapping.coupled_streams = packet.data[20];
+			m_mapping.mapping.assign(packet.data + 21,
+			                         packet.data + 21 + m_channels);
+		}
+	}
+
+	void parse_comment_header(const Packet &packet)
+	{
+		if (packet.size < 8 || memcmp(packet.data, "OpusTags", 8) != 0) {
+			throw OggOpusDemuxerError("Missing Opus comment header");
+		}
+
+		// Helper function reading a length-prefixed string
+		const uint8_t *p = packet.data + 8;
+		const uint8_t *end = packet.data + packet.size;
+		auto read_string = [&]() -> std::string {
+			if (end - p < 4 || size_t(end - p - 4) < read_u32(p)) {
+				throw OggOpusDemuxerError("Truncated Opus comment header");
+			}
+			const size_t len = read_u32(p);
+			std::string res(reinterpret_cast<const char *>(p + 4), len);
+			p += 4 + len;
+			return res;
+		};
+
+		m_vendor = read_string();
+		if (end - p < 4) {
+			throw OggOpusDemuxerError("Truncated Opus comment header");
+		}
+		const size_t n_tags = read_u32(p);
+		p += 4;
+		for (size_t i = 0; i < n_tags; i++) {
+			const std::string tag = read_string();
+			const size_t sep = tag.find('=');
+			if (sep == std::string::npos) {
+				m_tags.emplace_back(tag, std::string());
+			}
+			else {
+				m_tags.emplace_back(tag.substr(0, sep), tag.substr(sep + 1));
+			}
+		}
+	}
+
+public:
+	Impl(const uint8_t *data, size_t size) : m_data(data), m_size(size)
+	{
+		// Peek at the first packet. If it is an id header, read the id and
+		// comment headers, otherwise rewind.
+		Packet packet;
+		if (next(packet) && packet.size >= 8 &&
+		    memcmp(packet.data, "OpusHead", 8) == 0) {
+			parse_id_header(packet);
+			if (!next(packet)) {
+				throw OggOpusDemuxerError("Missing Opus comment header");
+			}
+			parse_comment_header(packet);
+			m_has_headers = true;
+		}
+		else {
+			m_next_page = 0;
+			m_n_segments = 0;
+			m_segment = 0;
+			m_has_page = false;
+		}
+	}
+
+	bool next(Packet &packet)
+	{
+		m_buf.clear();
+		bool continued = false;
+		while (true) {
+			// Fetch the next page if all segments of the current page have
+			// been consumed
+			while (m_segment >= m_n_segments) {
+				if (!next_page()) {
+					if (continued) {
+						throw OggOpusDemuxerError("Truncated Opus packet");
+					}
+					return false;
+				}
+				if (continued != bool(m_header_type & HEADER_TYPE_CONTINUED)) {
+					throw OggOpusDemuxerError("Unexpected page continuation");
+				}
+			}
+
+			// Collect the segments belonging to the packet
+			const size_t start = m_body_cursor;
+			bool complete = false;
+			while (m_segment < m_n_segments && !complete) {
+				m_body_cursor += m_lacing[m_segment];
+				complete = m_lacing[m_segment] < 255;
+				m_segment++;
+			}
+
+			// Return a pointer into the page if the packet does not span
+			// multiple pages, otherwise assemble the packet in the buffer
+			if (complete && !continued) {
+				packet.data = m_body + start;
+				packet.size = m_body_cursor - start;
+			}
+			else {
+				m_buf.insert(m_buf.end(), m_body + start,
+				             m_body + m_body_cursor);
+				packet.data = m_buf.data();
+				packet.size = m_buf.size();
+			}
+			if (complete) {
+				break;
+			}
+			continued = true;
+		}
+
+		// The granule position of a page applies to the last packet finished
+		// on that page
+		const bool last_on_page = std::none_of(
+		    m_lacing + m_segment, m_lacing + m_n_segments,
+		    [](uint8_t lacing) { return lacing < 255; });
+		packet.granule = last_on_page ? m_granule : -1;
+		packet.last = last_on_page && (m_header_type & HEADER_TYPE_LAST);
+		return true;
+	}
+
+	bool has_headers() const { return m_has_headers; }
+	size_t channels() const { return m_channels; }
+	size_t pre_skip() const { return m_pre_skip; }
+	size_t rate() const { return m_rate; }
+	const OggOpusMuxer::ChannelMapping &mapping() const { return m_mapping; }
+	const std::string &vendor() const { return m_vendor; }
+	const Tags &tags() const { return m_tags; }
+};
+
+/******************************************************************************
+ * Class OggOpusDemuxer                                                       *
+ ******************************************************************************/
+
+OggOpusDemuxer::OggOpusDemuxer(const uint8_t *data, size_t size)
+    : m_impl(std::make_unique<Impl>(data, size))
+{
+}
+
+OggOpusDemuxer::~OggOpusDemuxer()
+{
+	// Implicitly destroy m_impl
+}
+
+bool OggOpusDemuxer::has_headers() const { return m_impl->has_headers(); }
+
+size_t OggOpusDemuxer::channels() const { return m_impl->channels(); }
+
+size_t OggOpusDemuxer::pre_skip() const { return m_impl->pre_skip(); }
+
+size_t OggOpusDemuxer::rate() const { return m_impl->rate(); }
+
+const OggOpusMuxer::ChannelMapping &OggOpusDemuxer::mapping() const
+{
+	return m_impl->mapping();
+}
+
+const std::string &OggOpusDemuxer::vendor() const
+{
+	return m_impl->vendor();
+}
+
+const OggOpusDemuxer::Tags &OggOpusDemuxer::tags() const
+{
+	return m_impl->tags();
+}
+
+bool OggOpusDemuxer::next(Packet &packet) { return m_impl->next(packet); }
+}
+}
@@ -0,0 +1,158 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file ogg_opus_demuxer.hpp
+ *
+ * Implements a minimal demultiplexer which extracts Opus packets from an Ogg
+ * stream held in memory.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "ogg_opus_muxer.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The OggOpusDemuxer class reads the individual Opus packets from an Ogg
+ * stream stored in a memory buffer. Packets are returned as pointers into the
+ * buffer; only packets spanning multiple pages are copied to an internal
+ * buffer. If the stream starts with the id and comment headers, these are
+ * parsed and not returned as packets. This allows to read the header-less
+ * chunks written by the ChunkTranscoder as well. The checksum of each page is
+ * verified and all pages must belong to a single logical stream with
+ * consecutive page sequence numbers.
+ */
+class OggOpusDemuxer {
+private:
+	/**
+	 * Actual implementation of the OggOpusDemuxer.
+	 */
+	class Impl;
+	std::unique_ptr<Impl> m_impl;
+
+public:
+	/**
+	 * Data structure representing the key-value tag pairs read from the
+	 * comment header.
+	 */
+	using Tags = std::vector<std::tuple<std::string, std::string>>;
+
+	/**
+	 * The Packet structure describes a single Opus packet.
+	 */
+	struct Packet {
+		/**
+		 * Pointer at the packet data. Only valid until the next call to
+		 * next().
+		 */
+		const uint8_t *data = nullptr;
+
+		/**
+		 * Size of the packet in bytes.
+		 */
+		size_t size = 0;
+
+		/**
+		 * Granule position of the page the packet ends on if this is the last
+		 * packet finished on that page, -1 otherwise.
+		 */
+		int64_t granule = -1;
+
+		/**
+		 * True if this is the last packet in the stream.
+		 */
+		bool last = false;
+	};
+
+	/**
+	 * Creates a new OggOpusDemuxer reading from the given memory buffer and
+	 * parses the stream headers if present. Throws an exception if the stream
+	 * is malformed.
+	 *
+	 * @param data is a pointer at the Ogg stream. Must stay valid for the
+	 * lifetime of the demuxer.
+	 * @param size is the size of the Ogg stream in bytes.
+	 */
+	OggOpusDemuxer(const uint8_t *data, size_t size);
+
+	/**
+	 * Destroys the OggOpusDemuxer instance.
+	 */
+	~OggOpusDemuxer();
+
+	/**
+	 * Returns true if the stream started with the id and comment headers.
+	 * Otherwise channels(), pre_skip() and rate() are zero.
+	 */
+	bool has_headers() const;
+
+	/**
+	 * Number of channels stored in the id header.
+	 */
+	size_t channels() const;
+
+	/**
+	 * Number of samples (w.r.t. 48000 samples/s) stored in the id header that
+	 * must be discarded at the beginning of the decoded stream.
+	 */
+	size_t pre_skip() const;
+
+	/**
+	 * Sample rate of the original input stored in the id header.
+	 */
+	size_t rate() const;
+
+	/**
+	 * Channel mapping stored in the id header. The mapping family is zero
+	 * for mono and stereo streams.
+	 */
+	const OggOpusMuxer::ChannelMapping &mapping() const;
+
+	/**
+	 * Vendor string stored in the comment header, i.e. the name of the
+	 * library that encoded the stream.
+	 */
+	const std::string &vendor() const;
+
+	/**
+	 * Tags stored in the comment header. Keys are upper-case.
+	 */
+	const Tags &tags() const;
+
+	/**
+	 * Reads the next packet from the stream. Throws an exception if the
+	 * stream is malformed.
+	 *
+	 * @param packet is the structure the packet description is written to.
+	 * @return false if there are no more packets in the stream.
+	 */
+	bool next(Packet &packet);
+};
+}
+}
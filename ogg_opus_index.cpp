@@ -0,0 +1,106 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <opus/opus.h>
+
+#include "ogg_opus_demuxer.hpp"
+#include "ogg_opus_index.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The OggOpusIndexError class is used to signal that an Ogg/Opus stream
+ * cannot be indexed.
+ */
+class OggOpusIndexError : public std::runtime_error {
+public:
+	OggOpusIndexError(const std::string &msg) : std::runtime_error(msg) {}
+};
+
+/******************************************************************************
+ * Class OggOpusIndex                                                         *
+ ******************************************************************************/
+
+OggOpusIndex::OggOpusIndex(const uint8_t *data, size_t size)
+{
+	OggOpusDemuxer demuxer(data, size);
+	if (!demuxer.has_headers()) {
+		throw OggOpusIndexError("Stream has no Opus headers");
+	}
+	m_channels = demuxer.channels();
+	m_rate = demuxer.rate();
+	m_pre_skip = demuxer.pre_skip();
+	m_mapping = demuxer.mapping();
+	m_vendor = demuxer.vendor();
+
+	// Copy all packets and compute their position from their duration. The
+	// granule position of the last page marks the end of the stream. Streams
+	// cut out of a longer stream may start at a non-zero granule position;
+	// this offset is derived from the first page with a granule position.
+	OggOpusDemuxer::Packet packet;
+	size_t pos = 0;
+	int64_t granule = -1, granule_offs = -1;
+	while (demuxer.next(packet)) {
+		const int n =
+		    opus_packet_get_nb_samples(packet.data, packet.size, 48000);
+		if (n < 0) {
+			throw OggOpusIndexError("Invalid Opus packet");
+		}
+		m_offs.push_back(m_data.size());
+		m_start.push_back(pos);
+		m_data.insert(m_data.end(), packet.data, packet.data + packet.size);
+		pos += n;
+		if (packet.granule >= 0) {
+			granule = packet.granule;
+			if (granule_offs < 0) {
+				// The last page may trim the end of the stream, so its
+				// granule position does not determine the offset
+				granule_offs =
+				    packet.last ? 0
+				                : std::max<int64_t>(0, granule - int64_t(pos));
+			}
+		}
+	}
+	if (m_offs.empty()) {
+		throw OggOpusIndexError("Stream contains no Opus packets");
+	}
+	m_offs.push_back(m_data.size());
+	m_start.push_back(pos);
+	m_end = (granule >= 0)
+	            ? std::min<size_t>(std::max<int64_t>(granule - granule_offs, 0),
+	                               pos)
+	            : pos;
+}
+
+OggOpusIndex::Packet OggOpusIndex::packet(size_t i) const
+{
+	return Packet{m_data.data() + m_offs[i], m_offs[i + 1] - m_offs[i],
+	              m_start[i], m_start[i + 1] - m_start[i]};
+}
+
+size_t OggOpusIndex::packet_at(size_t pos) const
+{
+	const auto it = std::upper_bound(m_start.begin(), m_start.end() - 1, pos);
+	return std::max<ptrdiff_t>(it - m_start.begin(), 1) - 1;
+}
+}
+}
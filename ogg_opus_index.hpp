@@ -0,0 +1,163 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file ogg_opus_index.hpp
+ *
+ * Declares the OggOpusIndex class which locates all Opus packets within an
+ * Ogg/Opus stream, allowing random access to the stream.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ogg_opus_muxer.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The OggOpusIndex class demuxes an entire Ogg/Opus stream once and stores a
+ * copy of each packet along with the position of its first decoded sample.
+ * Positions are computed from the packet durations and are measured in
+ * samples at 48000 samples/s including the pre_skip, just like the granule
+ * positions of the Ogg pages. Positions always start at zero; if the granule
+ * positions of the stream start at a later position, e.g. because the stream
+ * was cut out of a longer stream, they are shifted accordingly. The granule
+ * position of the last page trims the end of the stream. The index is
+ * immutable once constructed, so it can be shared between multiple readers.
+ */
+class OggOpusIndex {
+public:
+	/**
+	 * Describes a single Opus packet in the stream.
+	 */
+	struct Packet {
+		/**
+		 * Pointer at the packet data. Valid for the lifetime of the index.
+		 */
+		const uint8_t *data;
+
+		/**
+		 * Size of the packet in bytes.
+		 */
+		size_t size;
+
+		/**
+		 * Position of the first sample decoded from the packet, including the
+		 * pre_skip.
+		 */
+		size_t start;
+
+		/**
+		 * Number of samples decoded from the packet.
+		 */
+		size_t duration;
+	};
+
+private:
+	size_t m_channels;
+	size_t m_rate;
+	size_t m_pre_skip;
+	OggOpusMuxer::ChannelMapping m_mapping;
+	std::string m_vendor;
+
+	/**
+	 * Position after the last sample in the stream, including the pre_skip.
+	 */
+	size_t m_end;
+
+	/**
+	 * Concatenated data of all packets, offsets of the individual packets
+	 * within this buffer and their start positions. Both m_offs and m_start
+	 * have one additional entry marking the end of the last packet.
+	 */
+	std::vector<uint8_t> m_data;
+	std::vector<size_t> m_offs;
+	std::vector<size_t> m_start;
+
+public:
+	/**
+	 * Demuxes the given Ogg/Opus stream. Throws an exception if the stream is
+	 * malformed or has no id and comment headers.
+	 *
+	 * @param data is a pointer at the Ogg/Opus stream. The packets are
+	 * copied, so the buffer does not need to outlive the index.
+	 * @param size is the size of the stream in bytes.
+	 */
+	OggOpusIndex(const uint8_t *data, size_t size);
+
+	/**
+	 * Number of channels stored in the id header.
+	 */
+	size_t channels() const { return m_channels; }
+
+	/**
+	 * Sample rate of the original input stored in the id header.
+	 */
+	size_t rate() const { return m_rate; }
+
+	/**
+	 * Number of samples that must be discarded at the beginning of the
+	 * decoded stream.
+	 */
+	size_t pre_skip() const { return m_pre_skip; }
+
+	/**
+	 * Channel mapping stored in the id header.
+	 */
+	const OggOpusMuxer::ChannelMapping &mapping() const { return m_mapping; }
+
+	/**
+	 * Vendor string stored in the comment header.
+	 */
+	const std::string &vendor() const { return m_vendor; }
+
+	/**
+	 * Number of samples in the stream after the pre_skip.
+	 */
+	size_t length() const
+	{
+		return (m_end > m_pre_skip) ? m_end - m_pre_skip : 0;
+	}
+
+	/**
+	 * Number of packets in the stream.
+	 */
+	size_t size() const { return m_offs.size() - 1; }
+
+	/**
+	 * Returns the packet with the given index.
+	 */
+	Packet packet(size_t i) const;
+
+	/**
+	 * Returns the index of the packet containing the given position, which
+	 * includes the pre_skip. Returns the first packet for positions before
+	 * the first packet and the last packet for positions after the end of
+	 * the stream.
+	 */
+	size_t packet_at(size_t pos) const;
+};
+}
+}
@@ -152,22 +152,37 @@ private:
 
 	std::ostream &m_os;
 	PageHeader m_page_header;
+	size_t m_packets_per_page = 0;
+	size_t m_page_packets = 0;
 	size_t m_page_buf_cursor = 0;
 	uint8_t m_page_buf[MAX_PAGE_SIZE];
 	uint8_t m_segment_lacing[MAX_PAGE_SEGMENTS];
 
 	void write_id_header(uint16_t pre_skip, uint8_t channel_count,
-	                     uint32_t sample_rate)
+	                     uint32_t sample_rate,
+	                     const OggOpusMuxer::ChannelMapping &mapping)
 	{
 		// Fill the header structure with the given data
 		IdHeader head;
 		head.channel_count = channel_count;
 		head.pre_skip = pre_skip;
 		head.sample_rate = sample_rate;
+		head.mapping_family = mapping.family;
+
+		// Append the channel mapping table for mapping families other than
+		// zero
+		std::vector<uint8_t> buf(reinterpret_cast<uint8_t *>(&head),
+		                         reinterpret_cast<uint8_t *>(&head) +
+		                             sizeof(head));
+		if (mapping.family != 0) {
+			buf.push_back(mapping.streams);
+			buf.push_back(mapping.coupled_streams);
+			buf.insert(buf.end(), mapping.mapping.begin(),
+			           mapping.mapping.end());
+		}
 
 		// Write the header as an individual packet in a single page
-		write_packet(true, false, 0, reinterpret_cast<uint8_t *>(&head),
-		             sizeof(head));
+		write_packet(true, false, 0, buf.data(), buf.size());
 		flush_page();
 	}
 
@@ -268,18 +283,26 @@ private:
 		m_page_header.sequence_number++;
 		m_page_header.checksum = 0;
 		m_page_header.page_segments = 0;
+		m_page_packets = 0;
 		m_page_buf_cursor = 0;
 	}
 
 public:
 	Impl(std::ostream &os, uint16_t pre_skip, const std::string &vendor,
 	     const OggOpusMuxer::Tags &tags, uint8_t channel_count,
-	     uint32_t sample_rate)
-	    : m_os(os)
+	     uint32_t sample_rate, bool headers, size_t packets_per_page,
+	     const OggOpusMuxer::ChannelMapping &mapping)
+	    : m_os(os), m_packets_per_page(packets_per_page)
 	{
-		// Write the mandatory headers
-		write_id_header(pre_skip, channel_count, sample_rate);
-		write_comment_header(vendor, tags);
+		// Write the mandatory headers. If the headers are omitted, skip the
+		// sequence numbers of the two header pages.
+		if (headers) {
+			write_id_header(pre_skip, channel_count, sample_rate, mapping);
+			write_comment_header(vendor, tags);
+		}
+		else {
+			m_page_header.sequence_number = 2;
+		}
 	}
 
 	~Impl()
@@ -338,6 +361,12 @@ public:
 		if (last) {
 			m_page_header.header_type |= HEADER_TYPE_LAST;
 		}
+
+		// Flush the page if it holds the requested number of packets
+		m_page_packets++;
+		if (m_packets_per_page > 0 && m_page_packets >= m_packets_per_page) {
+			flush_page();
+		}
 	}
 };
 
@@ -348,10 +377,25 @@ public:
 OggOpusMuxer::OggOpusMuxer(std::ostream &os, uint16_t pre_skip,
                            const std::string &vendor,
                            const OggOpusMuxer::Tags &tags,
-                           uint8_t channel_count, uint32_t sample_rate)
+                           uint8_t channel_count, uint32_t sample_rate,
+                           bool headers, size_t packets_per_page,
+                           const ChannelMapping &mapping)
     : m_impl(std::make_unique<Impl>(os, pre_skip, vendor, tags, channel_count,
-                                    sample_rate))
+                                    sample_rate, headers, packets_per_page,
+                                    mapping))
+{
+}
+
+void OggOpusMuxer::write_headers(std::ostream &os, uint16_t pre_skip,
+                                 const std::string &vendor,
+                                 const OggOpusMuxer::Tags &tags,
+                                 uint8_t channel_count, uint32_t sample_rate,
+                                 const ChannelMapping &mapping)
 {
+	// The Impl constructor writes the headers, the destructor does not write
+	// anything as long as no packet has been written.
+	Impl impl(os, pre_skip, vendor, tags, channel_count, sample_rate, true, 0,
+	          mapping);
 }
 
 void OggOpusMuxer::write_frame(bool last, int64_t granule, const uint8_t *buf,
@@ -36,6 +36,18 @@
 
 namespace eolian {
 namespace stream {
+/**
+ * Updates the given Ogg page checksum (CRC32 with polynomial 0x04c11db7) with
+ * the given data. The checksum is computed over the entire page with the
+ * checksum field set to zero.
+ *
+ * @param crc is the checksum that should be updated; should be zero for the
+ * first call.
+ * @param data is a pointer at the data.
+ * @param data_len is the number of bytes that should be processed.
+ */
+void crc_update(uint32_t &crc, const void *data, size_t data_len);
+
 /**
  * The OggOpusMuxer class packs a set of Opus frames into an Ogg stream along
  * with meta information required by the Opus decoder.
@@ -55,6 +67,26 @@ public:
 	 */
 	using Tags = std::vector<std::tuple<std::string, std::string>>;
 
+	/**
+	 * Channel mapping stored in the id header. Mapping family 0 describes a
+	 * single mono or stereo Opus stream. Mapping family 1 describes up to
+	 * eight channels in Vorbis channel order coded as multiple Opus streams,
+	 * where the first coupled_streams streams are stereo and the remaining
+	 * streams are mono. The mapping table assigns a decoded stream channel
+	 * to each output channel.
+	 */
+	struct ChannelMapping {
+		uint8_t family;
+		uint8_t streams;
+		uint8_t coupled_streams;
+		std::vector<uint8_t> mapping;
+
+		/**
+		 * Creates a mapping describing a single mono or stereo stream.
+		 */
+		ChannelMapping() : family(0), streams(1), coupled_streams(0) {}
+	};
+
 	/**
 	 * Starts writing the Ogg bitstream by writing the header information for
 	 * a single contained Opus audio stream with the given data.
@@ -68,12 +100,34 @@ public:
 	 * @param channel_count is the number of channels contained in the Opus
 	 * audio stream.
 	 * @param sample_rate is the sample rate of the Opus audio stream.
-	 * @param gain is a gain factor that should be applied to the audio data.
+	 * @param headers if false, the id and comment headers are not written. The
+	 * page sequence numbers still account for the two header pages, such that
+	 * the headers written by write_headers() can be prepended to the output to
+	 * obtain a valid Ogg/Opus stream.
+	 * @param packets_per_page if non-zero, each page is flushed after this
+	 * many packets, which results in a fixed page layout if all packets have
+	 * the same size. Otherwise pages are filled up to the maximum number of
+	 * segments.
+	 * @param mapping is the channel mapping written to the id header. Only
+	 * relevant if the mapping family is non-zero.
 	 */
 	OggOpusMuxer(std::ostream &os, uint16_t pre_skip,
 	             const std::string &vendor = std::string(),
 	             const Tags &tags = Tags(), uint8_t channel_count = 2,
-	             uint32_t sample_rate = 48000);
+	             uint32_t sample_rate = 48000, bool headers = true,
+	             size_t packets_per_page = 0,
+	             const ChannelMapping &mapping = ChannelMapping());
+
+	/**
+	 * Only writes the id and comment header pages to the given output stream.
+	 * The parameters are the same as those passed to the constructor.
+	 */
+	static void write_headers(std::ostream &os, uint16_t pre_skip,
+	                          const std::string &vendor = std::string(),
+	                          const Tags &tags = Tags(),
+	                          uint8_t channel_count = 2,
+	                          uint32_t sample_rate = 48000,
+	                          const ChannelMapping &mapping = ChannelMapping());
 
 	/**
 	 * Writes an Opus frame into the Ogg bitstream.
@@ -5,27 +5,108 @@
  * see https://www.gnu.org/licenses/AGPLv3
  */
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include <unistd.h>
 
+#include "chunk_remuxer.hpp"
 #include "chunk_transcoder.hpp"
+#include "manifest.hpp"
+#include "mapped_file.hpp"
+#include "opus_reader.hpp"
+#include "playlist.hpp"
+#include "wav_reader.hpp"
 
 using namespace eolian::stream;
 
-int main()
+int main(int argc, char *argv[])
 {
-	// Read raw audio data from stdin into continous memory, expects audio in
-	// raw float format, generate e.g. using ffmpeg:
-	// ffmpeg -loglevel error -i <IN FILE> -ac 2 -ar 48000 -f f32le -
-
-	// Encode blocks of the audio data into individual vectors of Opus frames
-	ChunkTranscoder trans(
-	    std::cin, 0,
-	    ChunkTranscoder::Settings().overlap(0.25).bitrate(96000).length(1.0));
+	ChunkTranscoder::Settings settings =
+	    ChunkTranscoder::Settings().overlap(0.25).bitrate(96000).length(1.0);
+
+	// If the first argument is --remux, split the Ogg/Opus file given as
+	// second argument into chunks by copying the original Opus packets
+	// instead of transcoding the audio. If the arguments are file names, read
+	// the audio directly from the given Ogg/Opus or WAV files. Multiple files
+	// are concatenated to a single gapless stream. Otherwise read raw audio data from stdin into continous
+	// memory, expects audio in raw float format, generate e.g. using ffmpeg:
+	// ffmpeg -loglevel error -i <IN FILE> -ac 2 -f f32le -
+	// In this case, the sample rate of the input may be passed as first
+	// argument. The audio is resampled to 48000 samples/s internally.
+	const std::string arg = (argc > 1) ? argv[1] : "";
+	std::vector<std::unique_ptr<WavReader>> wavs;
+	std::vector<std::unique_ptr<OpusReader>> opus;
+	std::unique_ptr<Playlist> playlist;
+	std::unique_ptr<ChunkTranscoder> trans_ptr;
+	std::unique_ptr<ChunkRemuxer> remuxer;
+	if (arg == "--remux") {
+		if (argc != 3) {
+			std::cerr << "Usage: " << argv[0] << " --remux <OPUS FILE>"
+			          << std::endl;
+			return 1;
+		}
+		const MappedFile file(argv[2]);
+		remuxer.reset(new ChunkRemuxer(file.data(), file.size(), settings));
+	}
+	else if (!arg.empty() && !std::all_of(arg.begin(), arg.end(), ::isdigit)) {
+		std::vector<Playlist::Callback> sources;
+		for (int i = 1; i < argc; i++) {
+			// Only look at the first bytes of the mapped file to decide
+			// whether this is an Ogg stream. The OpusReader copies the packets
+			// while indexing, so the mapping is released afterwards.
+			const MappedFile file(argv[i]);
+			size_t rate, channels;
+			if (file.size() >= 4 && memcmp(file.data(), "OggS", 4) == 0) {
+				opus.emplace_back(new OpusReader(file.data(), file.size()));
+				rate = 48000;
+				channels = opus.back()->channels();
+				sources.push_back(opus.back()->source());
+			}
+			else {
+				wavs.emplace_back(new WavReader(argv[i]));
+				rate = wavs.back()->rate();
+				channels = wavs.back()->channels();
+				sources.push_back(wavs.back()->source());
+			}
+			if (i == 1) {
+				settings.input_rate(rate).channels(channels);
+			}
+			else if (rate != settings.input_rate() ||
+			         channels != settings.channels()) {
+				std::cerr << argv[i] << ": All files must have the same sample "
+				          << "rate and number of channels" << std::endl;
+				return 1;
+			}
+		}
+		playlist.reset(new Playlist(settings.channels()));
+		for (int i = 1; i < argc; i++) {
+			playlist->push_back(sources[i - 1], argv[i]);
+		}
+		trans_ptr.reset(new ChunkTranscoder(playlist->source(), 0, settings));
+	}
+	else {
+		settings.input_rate(arg.empty() ? 48000 : std::stoul(arg));
+		trans_ptr.reset(new ChunkTranscoder(std::cin, 0, settings));
+	}
+
+	// Encode blocks of the audio data into individual vectors of Opus frames.
+	// Remuxed chunks have the same layout and are written in the same way.
+	auto next_chunk = [&](std::ostream &os) {
+		return remuxer ? remuxer->remux(os) : trans_ptr->transcode(os);
+	};
+	auto last_chunk = [&]() -> const ChunkTranscoder::Chunk & {
+		return remuxer ? remuxer->last_chunk() : trans_ptr->last_chunk();
+	};
+	Manifest manifest(remuxer ? remuxer->settings() : trans_ptr->settings());
 	size_t idx = 0;
 	std::stringstream ss;
 	while (true) {
@@ -34,9 +115,10 @@ int main()
 		   << ".ogg";
 		std::cerr << "Writing " << ss.str() << std::endl;
 		std::ofstream os(ss.str());
-		if (!trans.transcode(os)) {
+		if (!next_chunk(os)) {
 			break;
 		}
+		manifest.push_back(last_chunk());
 	}
 
 	// Delete the last block
@@ -44,4 +126,12 @@ int main()
 		std::string fn = ss.str();
 		unlink(fn.c_str());
 	}
+
+	// Write the manifest describing all blocks, record the position of the
+	// individual files if multiple files were concatenated
+	if (argc > 2 && playlist) {
+		manifest.tracks(playlist->tracks());
+	}
+	std::ofstream os("blocks/manifest.json");
+	manifest.write_json(os);
 }
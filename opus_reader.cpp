@@ -0,0 +1,161 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "decoder.hpp"
+#include "opus_reader.hpp"
+
+namespace eolian {
+namespace stream {
+/******************************************************************************
+ * Struct OpusReader::Impl                                                    *
+ ******************************************************************************/
+
+struct OpusReader::Impl {
+	std::shared_ptr<const OggOpusIndex> index;
+	Decoder decoder;
+
+	/**
+	 * Samples decoded from the last packet, the number of decoded samples and
+	 * the number of samples that have already been consumed.
+	 */
+	std::vector<float> buf;
+	size_t buf_size = 0;
+	size_t buf_ptr = 0;
+
+	/**
+	 * Index of the next packet that should be decoded.
+	 */
+	size_t next_packet = 0;
+
+	/**
+	 * Number of decoded samples that still must be discarded after seeking.
+	 */
+	size_t skip = 0;
+
+	/**
+	 * Position of the next sample returned by read().
+	 */
+	size_t pos = 0;
+
+	Impl(std::shared_ptr<const OggOpusIndex> index)
+	    : index(index),
+	      decoder(index->channels(), 48000, index->mapping()),
+	      buf(Decoder::max_packet_samples(48000) * index->channels())
+	{
+		seek(0);
+	}
+
+	void seek(size_t offs)
+	{
+		// Start decoding PRE_ROLL samples before the target position and
+		// discard all samples before it
+		pos = std::min(offs, index->length());
+		const size_t target = pos + index->pre_skip();
+		next_packet =
+		    index->packet_at(target > PRE_ROLL ? target - PRE_ROLL : 0);
+		skip = target - index->packet(next_packet).start;
+		buf_size = 0;
+		buf_ptr = 0;
+		decoder.reset();
+	}
+
+	size_t read(float *tar, size_t n_tar)
+	{
+		const size_t channels = index->channels();
+		size_t n = 0;
+		while (n < n_tar && pos < index->length()) {
+			// Decode the next packet once the buffer has been consumed
+			if (buf_ptr == buf_size) {
+				if (next_packet >= index->size()) {
+					break;
+				}
+				const OggOpusIndex::Packet packet =
+				    index->packet(next_packet++);
+				buf_size = decoder.decode(packet.data, packet.size,
+				                          buf.data(), buf.size() / channels);
+				buf_ptr = std::min(skip, buf_size);
+				skip -= buf_ptr;
+				continue;
+			}
+
+			// Copy the decoded samples up to the end of the stream
+			const size_t n_copy = std::min({buf_size - buf_ptr, n_tar - n,
+			                                index->length() - pos});
+			std::copy(buf.data() + buf_ptr * channels,
+			          buf.data() + (buf_ptr + n_copy) * channels,
+			          tar + n * channels);
+			buf_ptr += n_copy;
+			pos += n_copy;
+			n += n_copy;
+		}
+		return n;
+	}
+};
+
+/******************************************************************************
+ * Class OpusReader                                                           *
+ ******************************************************************************/
+
+constexpr size_t OpusReader::PRE_ROLL;
+
+OpusReader::OpusReader(const uint8_t *data, size_t size)
+    : m_impl(std::make_unique<Impl>(
+          std::make_shared<const OggOpusIndex>(data, size)))
+{
+}
+
+OpusReader::OpusReader(std::shared_ptr<const OggOpusIndex> index)
+    : m_impl(std::make_unique<Impl>(index))
+{
+}
+
+OpusReader::~OpusReader()
+{
+	// Implicitly destroy m_impl
+}
+
+std::shared_ptr<const OggOpusIndex> OpusReader::index() const
+{
+	return m_impl->index;
+}
+
+size_t OpusReader::channels() const { return m_impl->index->channels(); }
+
+size_t OpusReader::length() const { return m_impl->index->length(); }
+
+size_t OpusReader::tell() const { return m_impl->pos; }
+
+void OpusReader::seek(size_t offs) { m_impl->seek(offs); }
+
+size_t OpusReader::read(float *tar, size_t n_tar)
+{
+	return m_impl->read(tar, n_tar);
+}
+
+OpusReader::Callback OpusReader::source(size_t offs)
+{
+	seek(offs);
+	return [this](float *buf, size_t buf_size) {
+		return read(buf, buf_size);
+	};
+}
+}
+}
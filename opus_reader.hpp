@@ -0,0 +1,142 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file opus_reader.hpp
+ *
+ * Declares the OpusReader class which decodes an Ogg/Opus stream to floating
+ * point samples, e.g. as input for the ChunkTranscoder.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "ogg_opus_index.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The OpusReader class decodes an Ogg/Opus stream at 48000 samples/s. The
+ * first pre_skip samples of the stream are discarded and the decoded stream
+ * ends at the granule position of the last page. Random access is provided
+ * by looking up the packet containing the target position in an
+ * OggOpusIndex; decoding starts PRE_ROLL samples before the target position
+ * such that the decoder has converged once the target position is reached.
+ *
+ * Each OpusReader has its own decoder state. Several readers may share a
+ * single index, e.g. to encode chunks in parallel.
+ */
+class OpusReader {
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_impl;
+
+public:
+	/**
+	 * Callback reading consecutive samples, compatible with
+	 * ChunkTranscoder::DecoderCallback.
+	 */
+	using Callback = std::function<size_t(float *buf, size_t buf_size)>;
+
+	/**
+	 * Number of samples decoded and discarded before the target position
+	 * when seeking (80 ms), as recommended by RFC 7845.
+	 */
+	static constexpr size_t PRE_ROLL = 3840;
+
+	/**
+	 * Indexes the given Ogg/Opus stream and positions the reader at its
+	 * beginning. Throws an exception if the stream is malformed.
+	 *
+	 * @param data is a pointer at the Ogg/Opus stream. The packets are
+	 * copied, so the buffer does not need to outlive the reader.
+	 * @param size is the size of the stream in bytes.
+	 */
+	OpusReader(const uint8_t *data, size_t size);
+
+	/**
+	 * Creates a reader for an already indexed stream and positions it at the
+	 * beginning of the stream.
+	 *
+	 * @param index is the index of the stream, which may be shared with
+	 * other readers.
+	 */
+	explicit OpusReader(std::shared_ptr<const OggOpusIndex> index);
+
+	/**
+	 * Destroys the OpusReader instance.
+	 */
+	~OpusReader();
+
+	/**
+	 * Returns the index of the stream.
+	 */
+	std::shared_ptr<const OggOpusIndex> index() const;
+
+	/**
+	 * Returns the number of interleaved channels of the decoded samples.
+	 */
+	size_t channels() const;
+
+	/**
+	 * Returns the number of samples in the decoded stream.
+	 */
+	size_t length() const;
+
+	/**
+	 * Returns the position of the next sample returned by read().
+	 */
+	size_t tell() const;
+
+	/**
+	 * Moves the reader to the given position.
+	 *
+	 * @param offs is the index of the next sample returned by read(). Is
+	 * limited to the length of the stream.
+	 */
+	void seek(size_t offs);
+
+	/**
+	 * Decodes samples at the current position. Throws an exception if a
+	 * packet cannot be decoded.
+	 *
+	 * @param tar is the buffer into which the samples should be written.
+	 * @param n_tar is the number of multi-channel samples to read.
+	 * @return the number of samples that have actually been read, which is
+	 * smaller than n_tar if the end of the stream has been reached.
+	 */
+	size_t read(float *tar, size_t n_tar);
+
+	/**
+	 * Seeks to the given position and returns a callback reading consecutive
+	 * samples from there. The callback can be passed to the ChunkTranscoder
+	 * along with the same offset as decoder offset. The OpusReader instance
+	 * must outlive the callback.
+	 *
+	 * @param offs is the index of the first sample returned by the callback.
+	 */
+	Callback source(size_t offs = 0);
+};
+}
+}
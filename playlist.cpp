@@ -0,0 +1,65 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cassert>
+
+#include "playlist.hpp"
+
+namespace eolian {
+namespace stream {
+/******************************************************************************
+ * Class Playlist                                                             *
+ ******************************************************************************/
+
+void Playlist::push_back(Callback source, const std::string &name)
+{
+	assert(m_current == 0);
+	m_sources.push_back(source);
+	m_tracks.emplace_back();
+	m_tracks.back().name = name;
+}
+
+size_t Playlist::read(float *tar, size_t n_tar)
+{
+	size_t n = 0;
+	while (n < n_tar && m_current < m_sources.size()) {
+		// Read from the current track. If it ends, fill the remainder of the
+		// buffer with the next track.
+		const size_t n_read =
+		    m_sources[m_current](tar + n * m_channels, n_tar - n);
+		Track &track = m_tracks[m_current];
+		track.length += n_read;
+		n += n_read;
+		if (n < n_tar) {
+			m_current++;
+			if (m_current < m_tracks.size()) {
+				m_tracks[m_current].offs = track.offs + track.length;
+			}
+		}
+	}
+	return n;
+}
+
+Playlist::Callback Playlist::source()
+{
+	return [this](float *buf, size_t buf_size) {
+		return read(buf, buf_size);
+	};
+}
+}
+}
@@ -0,0 +1,133 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file playlist.hpp
+ *
+ * Declares the Playlist class which concatenates multiple audio sources, e.g.
+ * the tracks of an album, into a single continuous stream.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace eolian {
+namespace stream {
+/**
+ * The Playlist class reads a list of sources one after another and presents
+ * them as a single stream without any gaps. Passing this stream to the
+ * ChunkTranscoder places all tracks on a common timeline, such that chunks
+ * may span track boundaries. While reading, the Playlist records the offset
+ * and length of each track within the continuous stream.
+ *
+ * All sources must provide the same number of channels at the same sample
+ * rate.
+ */
+class Playlist {
+public:
+	/**
+	 * Callback reading interleaved samples from a single track, compatible
+	 * with ChunkTranscoder::DecoderCallback. A return value smaller than
+	 * buf_size marks the end of the track.
+	 */
+	using Callback = std::function<size_t(float *buf, size_t buf_size)>;
+
+	/**
+	 * Position of a single track within the continuous stream.
+	 */
+	struct Track {
+		/**
+		 * Name of the track, e.g. the file name.
+		 */
+		std::string name;
+
+		/**
+		 * Offset of the first sample of the track within the stream.
+		 */
+		size_t offs = 0;
+
+		/**
+		 * Number of samples in the track. Only valid once the track has been
+		 * read to its end.
+		 */
+		size_t length = 0;
+	};
+
+private:
+	std::vector<Callback> m_sources;
+	std::vector<Track> m_tracks;
+
+	/**
+	 * Number of channels provided by the sources.
+	 */
+	size_t m_channels;
+
+	/**
+	 * Index of the track that is currently being read.
+	 */
+	size_t m_current = 0;
+
+public:
+	/**
+	 * Creates a new, empty Playlist.
+	 *
+	 * @param channels is the number of interleaved channels provided by all
+	 * sources.
+	 */
+	explicit Playlist(size_t channels = 2) : m_channels(channels) {}
+
+	/**
+	 * Appends a track to the playlist. Must not be called once reading has
+	 * started.
+	 *
+	 * @param source is the callback providing the samples of the track.
+	 * @param name is the name of the track stored in the manifest.
+	 */
+	void push_back(Callback source, const std::string &name = std::string());
+
+	/**
+	 * Returns the tracks in the playlist. Offsets and lengths are only final
+	 * once the playlist has been read to its end.
+	 */
+	const std::vector<Track> &tracks() const { return m_tracks; }
+
+	/**
+	 * Reads samples from the current track and continues with the next
+	 * track once the current track has ended.
+	 *
+	 * @param tar is the buffer into which the samples should be written.
+	 * @param n_tar is the number of multi-channel samples to read.
+	 * @return the number of samples that have actually been read, which is
+	 * smaller than n_tar if the last track has ended.
+	 */
+	size_t read(float *tar, size_t n_tar);
+
+	/**
+	 * Returns a callback reading from the playlist, which can be passed to
+	 * the ChunkTranscoder. The Playlist instance must outlive the callback.
+	 */
+	Callback source();
+};
+}
+}
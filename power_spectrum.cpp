@@ -0,0 +1,119 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "power_spectrum.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * Computes n radix-2 butterflies on the two halves a and b of a block. The
+ * real and imaginary parts as well as the twiddle factors are stored in
+ * separate contiguous arrays that do not overlap, which allows the compiler
+ * to vectorise the loop.
+ */
+static void butterflies(float *__restrict re_a, float *__restrict im_a,
+                        float *__restrict re_b, float *__restrict im_b,
+                        const float *__restrict wr,
+                        const float *__restrict wi, size_t n)
+{
+	for (size_t k = 0; k < n; k++) {
+		const float tr = re_b[k] * wr[k] - im_b[k] * wi[k];
+		const float ti = re_b[k] * wi[k] + im_b[k] * wr[k];
+		re_b[k] = re_a[k] - tr;
+		im_b[k] = im_a[k] - ti;
+		re_a[k] += tr;
+		im_a[k] += ti;
+	}
+}
+
+/******************************************************************************
+ * Class PowerSpectrum                                                        *
+ ******************************************************************************/
+
+PowerSpectrum::PowerSpectrum(size_t size)
+    : m_size(size),
+      m_window(size),
+      m_cos(size - 1),
+      m_sin(size - 1),
+      m_bitrev(size),
+      m_re(size),
+      m_im(size)
+{
+	assert(size >= 2 && (size & (size - 1)) == 0);
+
+	const double pi = std::acos(-1.0);
+	for (size_t i = 0; i < size; i++) {
+		m_window[i] = 0.5 - 0.5 * std::cos(2.0 * pi * i / size);
+	}
+	for (size_t half = 1; half < size; half *= 2) {
+		for (size_t k = 0; k < half; k++) {
+			m_cos[half - 1 + k] = std::cos(pi * k / half);
+			m_sin[half - 1 + k] = -std::sin(pi * k / half);
+		}
+	}
+	size_t bits = 0;
+	while ((size_t(1) << bits) < size) {
+		bits++;
+	}
+	for (size_t i = 0; i < size; i++) {
+		size_t r = 0;
+		for (size_t j = 0; j < bits; j++) {
+			r |= ((i >> j) & 1) << (bits - 1 - j);
+		}
+		m_bitrev[i] = r;
+	}
+}
+
+void PowerSpectrum::compute(const float *src, size_t n_src, size_t channels,
+                            float *tar)
+{
+	// Mix the channels down to mono, apply the window and store the samples
+	// in bit-reversed order. Missing samples are zero.
+	const float scale = 1.0f / channels;
+	std::fill(m_im.begin(), m_im.end(), 0.0f);
+	for (size_t i = 0; i < m_size; i++) {
+		float x = 0.0f;
+		if (i < n_src) {
+			for (size_t j = 0; j < channels; j++) {
+				x += src[i * channels + j];
+			}
+		}
+		m_re[m_bitrev[i]] = x * scale * m_window[i];
+	}
+
+	// Iterative radix-2 FFT
+	float *re = m_re.data(), *im = m_im.data();
+	for (size_t half = 1; half < m_size; half *= 2) {
+		const float *wr = m_cos.data() + half - 1;
+		const float *wi = m_sin.data() + half - 1;
+		for (size_t i = 0; i < m_size; i += 2 * half) {
+			butterflies(re + i, im + i, re + i + half, im + i + half, wr, wi,
+			            half);
+		}
+	}
+
+	for (size_t i = 0; i < n_bins(); i++) {
+		tar[i] = re[i] * re[i] + im[i] * im[i];
+	}
+}
+}
+}
@@ -0,0 +1,93 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file power_spectrum.hpp
+ *
+ * Declares the PowerSpectrum class which computes the power spectrum of a
+ * short window of a multi-channel signal using an FFT.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace eolian {
+namespace stream {
+/**
+ * The PowerSpectrum class mixes a window of an interleaved multi-channel
+ * signal down to mono, applies a Hann window and computes its power spectrum
+ * using an iterative radix-2 FFT. All tables are precomputed on construction,
+ * so computing a spectrum does not allocate memory.
+ */
+class PowerSpectrum {
+private:
+	size_t m_size;
+
+	/**
+	 * Hann window, twiddle factors and bit-reversal permutation. The twiddle
+	 * factors of the FFT stage combining blocks of length half are stored
+	 * contiguously starting at index half - 1.
+	 */
+	std::vector<float> m_window;
+	std::vector<float> m_cos;
+	std::vector<float> m_sin;
+	std::vector<size_t> m_bitrev;
+
+	/**
+	 * Real and imaginary part of the FFT working buffer.
+	 */
+	std::vector<float> m_re;
+	std::vector<float> m_im;
+
+public:
+	/**
+	 * Creates a new PowerSpectrum instance.
+	 *
+	 * @param size is the number of samples in each window. Must be a power
+	 * of two.
+	 */
+	PowerSpectrum(size_t size);
+
+	/**
+	 * Returns the number of samples in each window.
+	 */
+	size_t size() const { return m_size; }
+
+	/**
+	 * Returns the number of frequency bins, i.e. size() / 2 + 1. Bin i
+	 * corresponds to the frequency i * rate / size().
+	 */
+	size_t n_bins() const { return m_size / 2 + 1; }
+
+	/**
+	 * Computes the power spectrum of the given window.
+	 *
+	 * @param src is a pointer at the interleaved samples.
+	 * @param n_src is the number of multi-channel samples. If smaller than
+	 * size(), the window is zero-padded; excess samples are ignored.
+	 * @param channels is the number of interleaved channels.
+	 * @param tar is the target buffer with space for n_bins() values.
+	 */
+	void compute(const float *src, size_t n_src, size_t channels, float *tar);
+};
+}
+}
@@ -0,0 +1,62 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "quality.hpp"
+
+namespace eolian {
+namespace stream {
+
+/**
+ * Lower and upper bound of the per-segment SNR in dB.
+ */
+static constexpr double SNR_MIN = -10.0;
+static constexpr double SNR_MAX = 50.0;
+
+/**
+ * Mean signal power below which a segment is considered silent (-60 dBFS).
+ */
+static constexpr double SILENCE_POWER = 1e-6;
+
+float segmental_snr(const float *ref, const float *deg, size_t n,
+                    size_t channels, size_t segment)
+{
+	double sum = 0.0;
+	size_t n_segments = 0;
+	for (size_t i = 0; i < n; i += segment) {
+		const size_t i1 = std::min(n, i + segment) * channels;
+		double signal = 0.0, noise = 0.0;
+		for (size_t j = i * channels; j < i1; j++) {
+			const double d = double(ref[j]) - double(deg[j]);
+			signal += double(ref[j]) * double(ref[j]);
+			noise += d * d;
+		}
+		if (signal < SILENCE_POWER * (i1 - i * channels)) {
+			continue;
+		}
+		const double snr =
+		    (noise > 0.0) ? 10.0 * std::log10(signal / noise) : SNR_MAX;
+		sum += std::min(SNR_MAX, std::max(SNR_MIN, snr));
+		n_segments++;
+	}
+	return (n_segments == 0) ? SNR_MAX : sum / n_segments;
+}
+}
+}
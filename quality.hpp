@@ -0,0 +1,52 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file quality.hpp
+ *
+ * Provides objective distortion metrics used to compare decoded audio with
+ * the original input.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace eolian {
+namespace stream {
+/**
+ * Segmental signal-to-noise ratio in dB between a reference signal and a
+ * degraded version of it. The SNR is computed for each segment and averaged
+ * over all segments; each per-segment SNR is clamped to [-10, 50] dB. Segments
+ * in which the reference signal is (close to) silent are not taken into
+ * account, since their SNR is dominated by the noise floor. Returns the upper
+ * clamp value if all segments are silent.
+ *
+ * @param ref is the interleaved reference signal.
+ * @param deg is the interleaved degraded signal.
+ * @param n is the number of multi-channel samples in both buffers.
+ * @param channels is the number of interleaved channels.
+ * @param segment is the number of samples per segment.
+ * @return the segmental SNR in dB.
+ */
+float segmental_snr(const float *ref, const float *deg, size_t n,
+                    size_t channels, size_t segment);
+}
+}
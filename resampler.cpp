@@ -0,0 +1,217 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include "resampler.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The ResamplerError class is used to signal unsupported sample rate
+ * conversions.
+ */
+class ResamplerError : public std::runtime_error {
+public:
+	ResamplerError(size_t rate_in, size_t rate_out)
+	    : std::runtime_error("Unsupported sample rate conversion from " +
+	                         std::to_string(rate_in) + " to " +
+	                         std::to_string(rate_out) + " samples/s.")
+	{
+	}
+};
+
+/**
+ * Zeroth order modified Bessel function of the first kind, required for the
+ * Kaiser window.
+ */
+static double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	for (size_t k = 1; k < 64 && term > 1e-12 * sum; k++) {
+		term *= (0.25 * x * x) / double(k * k);
+		sum += term;
+	}
+	return sum;
+}
+
+/**
+ * Inner product of two vectors. Uses several independent accumulators, which
+ * allows the compiler to vectorise the loop.
+ */
+static float dot(const float *a, const float *b, size_t n)
+{
+	static constexpr size_t LANES = 8;
+	float acc[LANES] = {0.0f};
+	size_t i = 0;
+	for (; i + LANES <= n; i += LANES) {
+		for (size_t j = 0; j < LANES; j++) {
+			acc[j] += a[i + j] * b[i + j];
+		}
+	}
+	for (; i < n; i++) {
+		acc[0] += a[i] * b[i];
+	}
+	float sum = 0.0f;
+	for (size_t j = 0; j < LANES; j++) {
+		sum += acc[j];
+	}
+	return sum;
+}
+
+/******************************************************************************
+ * Class Resampler                                                            *
+ ******************************************************************************/
+
+constexpr size_t Resampler::HALF_TAPS;
+constexpr double Resampler::ROLLOFF;
+constexpr double Resampler::BETA;
+constexpr size_t Resampler::MAX_PHASES;
+constexpr size_t Resampler::BLOCK_SIZE;
+
+Resampler::Resampler(Source source, size_t channels, size_t rate_in,
+                     size_t rate_out)
+    : m_source(source),
+      m_channels(channels),
+      m_history(channels),
+      m_in_buf(BLOCK_SIZE * channels),
+      m_pos(0),
+      m_phase(0),
+      m_eof(false)
+{
+	// Reduce the conversion ratio
+	size_t a = rate_in, b = rate_out;
+	while (b != 0) {
+		const size_t t = a % b;
+		a = b;
+		b = t;
+	}
+	if (a == 0 || rate_out / a > MAX_PHASES) {
+		throw ResamplerError(rate_in, rate_out);
+	}
+	m_up = rate_out / a;
+	m_down = rate_in / a;
+
+	// Cutoff frequency relative to the input Nyquist frequency and the
+	// half-width of the kernel in input samples. The number of taps is
+	// rounded to a multiple of eight.
+	const double fc = ROLLOFF * std::min(1.0, double(m_up) / double(m_down));
+	const size_t half_width = (size_t(std::ceil(HALF_TAPS / fc)) + 3) / 4 * 4;
+	m_taps = 2 * half_width;
+
+	// Compute the Kaiser-windowed sinc kernel for each phase. Tap k of phase
+	// p is applied to the input sample at distance p / L + W - 1 - k from the
+	// output sample. Each phase is normalised to unity gain at DC.
+	const double i0_beta = bessel_i0(BETA);
+	m_filter.resize(m_up * m_taps);
+	for (size_t p = 0; p < m_up; p++) {
+		double sum = 0.0;
+		for (size_t k = 0; k < m_taps; k++) {
+			const double u = double(p) / m_up + double(half_width) - 1.0 - k;
+			const double x = u / half_width;
+			const double w =
+			    std::abs(x) < 1.0
+			        ? bessel_i0(BETA * std::sqrt(1.0 - x * x)) / i0_beta
+			        : 0.0;
+			const double t = M_PI * fc * u;
+			const double sinc = (t == 0.0) ? 1.0 : std::sin(t) / t;
+			const double h = fc * sinc * w;
+			m_filter[p * m_taps + k] = h;
+			sum += h;
+		}
+		for (size_t k = 0; k < m_taps; k++) {
+			m_filter[p * m_taps + k] /= sum;
+		}
+	}
+
+	// The first output sample is centered on the first input sample, pad the
+	// history with zeros preceding the stream
+	for (std::vector<float> &history : m_history) {
+		history.assign(half_width - 1, 0.0f);
+	}
+	m_end = half_width - 1;
+}
+
+void Resampler::fill()
+{
+	// Discard samples that are no longer required
+	if (m_pos >= BLOCK_SIZE) {
+		for (std::vector<float> &history : m_history) {
+			history.erase(history.begin(), history.begin() + m_pos);
+		}
+		m_end -= m_pos;
+		m_pos = 0;
+	}
+
+	// Read the next block and deinterleave it
+	const size_t n = m_source(m_in_buf.data(), BLOCK_SIZE);
+	for (size_t c = 0; c < m_channels; c++) {
+		std::vector<float> &history = m_history[c];
+		const size_t offs = history.size();
+		history.resize(offs + n);
+		for (size_t i = 0; i < n; i++) {
+			history[offs + i] = m_in_buf[i * m_channels + c];
+		}
+	}
+	m_end += n;
+
+	// Pad the stream with zeros following its end
+	if (n < BLOCK_SIZE) {
+		for (std::vector<float> &history : m_history) {
+			history.resize(history.size() + m_taps / 2, 0.0f);
+		}
+		m_eof = true;
+	}
+}
+
+size_t Resampler::read(float *tar, size_t n_tar)
+{
+	const size_t half_width = m_taps / 2;
+	size_t i = 0;
+	for (; i < n_tar; i++) {
+		// Make sure all input samples required for the next output sample are
+		// available
+		while (!m_eof && m_history[0].size() < m_pos + m_taps) {
+			fill();
+		}
+
+		// Stop once the output sample would be located after the last input
+		// sample
+		if (m_pos + half_width - 1 >= m_end) {
+			break;
+		}
+
+		// Apply the filter phase to each channel
+		const float *filter = &m_filter[m_phase * m_taps];
+		for (size_t c = 0; c < m_channels; c++) {
+			tar[i * m_channels + c] =
+			    dot(&m_history[c][m_pos], filter, m_taps);
+		}
+
+		// Advance the input position by M / L
+		m_phase += m_down;
+		m_pos += m_phase / m_up;
+		m_phase %= m_up;
+	}
+	return i;
+}
+}
+}
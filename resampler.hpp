@@ -0,0 +1,178 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file resampler.hpp
+ *
+ * Declares the Resampler class, a streaming polyphase sample rate converter
+ * used to feed audio at arbitrary sample rates into the ChunkTranscoder.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace eolian {
+namespace stream {
+/**
+ * The Resampler class converts a stream of interleaved floating point samples
+ * from one sample rate to another by the rational factor L/M, where L and M
+ * are the output and input rate divided by their greatest common divisor.
+ * Conceptually, the input is upsampled by L, filtered with a Kaiser-windowed
+ * sinc lowpass and decimated by M; only the L polyphase components of the
+ * filter that are actually required are evaluated.
+ *
+ * The Resampler pulls data from a source callback and is itself used like
+ * such a callback. Its state is kept across calls to read(), so the output is
+ * independent of how the stream is partitioned into reads. Output sample n
+ * corresponds to the input time n * M / L, i.e. the first output sample is
+ * aligned to the first input sample.
+ */
+class Resampler {
+public:
+	/**
+	 * Callback reading interleaved samples from the underlying stream.
+	 *
+	 * @param buf is the buffer into which the samples should be read.
+	 * @param buf_size is the number of multi-channel samples to read.
+	 * @return the number of samples that have actually been read. A value
+	 * smaller than buf_size marks the end of the stream.
+	 */
+	using Source = std::function<size_t(float *buf, size_t buf_size)>;
+
+	/**
+	 * Number of zero crossings of the sinc kernel on either side of its
+	 * center at the lower of the two sample rates.
+	 */
+	static constexpr size_t HALF_TAPS = 16;
+
+	/**
+	 * Cutoff frequency of the anti-aliasing filter relative to the Nyquist
+	 * frequency of the lower of the two sample rates.
+	 */
+	static constexpr double ROLLOFF = 0.95;
+
+	/**
+	 * Shape parameter of the Kaiser window; yields a stopband attenuation of
+	 * about 85 dB.
+	 */
+	static constexpr double BETA = 8.6;
+
+	/**
+	 * Maximum number of filter phases L. Limits the memory used by the filter
+	 * table for sample rates with a small common divisor.
+	 */
+	static constexpr size_t MAX_PHASES = 1024;
+
+	/**
+	 * Number of multi-channel samples read from the source at once.
+	 */
+	static constexpr size_t BLOCK_SIZE = 1024;
+
+private:
+	Source m_source;
+	size_t m_channels;
+
+	/**
+	 * Upsampling factor L and downsampling factor M.
+	 */
+	size_t m_up;
+	size_t m_down;
+
+	/**
+	 * Number of filter taps per phase. The filter for phase p is stored in
+	 * m_filter[p * m_taps] to m_filter[(p + 1) * m_taps - 1].
+	 */
+	size_t m_taps;
+	std::vector<float> m_filter;
+
+	/**
+	 * Input samples deinterleaved into one contiguous buffer per channel,
+	 * such that the inner product with the filter accesses consecutive
+	 * memory. The first m_taps / 2 - 1 samples initially are zero.
+	 */
+	std::vector<std::vector<float>> m_history;
+
+	/**
+	 * Buffer the interleaved input is read into.
+	 */
+	std::vector<float> m_in_buf;
+
+	/**
+	 * Position of the first filter tap of the next output sample within
+	 * m_history and the corresponding filter phase.
+	 */
+	size_t m_pos;
+	size_t m_phase;
+
+	/**
+	 * Index one past the last input sample within m_history and flag
+	 * indicating whether the source has reached its end.
+	 */
+	size_t m_end;
+	bool m_eof;
+
+	/**
+	 * Reads the next block from the source and appends it to the history.
+	 * Appends the zero padding required for the last output samples once the
+	 * source has reached its end.
+	 */
+	void fill();
+
+public:
+	/**
+	 * Creates a new Resampler instance. Throws an exception if the ratio
+	 * between the two sample rates requires more than MAX_PHASES filter
+	 * phases.
+	 *
+	 * @param source is the callback providing the input samples.
+	 * @param channels is the number of interleaved channels.
+	 * @param rate_in is the sample rate of the source.
+	 * @param rate_out is the sample rate of the samples returned by read().
+	 */
+	Resampler(Source source, size_t channels, size_t rate_in,
+	          size_t rate_out);
+
+	/**
+	 * Returns the upsampling factor L.
+	 */
+	size_t up() const { return m_up; }
+
+	/**
+	 * Returns the downsampling factor M.
+	 */
+	size_t down() const { return m_down; }
+
+	/**
+	 * Reads resampled data. Once the source has reached its end, a total of
+	 * ceil(n_in * L / M) samples will have been returned, where n_in is the
+	 * number of samples provided by the source.
+	 *
+	 * @param tar is the buffer into which the samples should be written.
+	 * @param n_tar is the number of multi-channel samples to read.
+	 * @return the number of samples that have actually been written. A value
+	 * smaller than n_tar marks the end of the stream.
+	 */
+	size_t read(float *tar, size_t n_tar);
+};
+}
+}
@@ -0,0 +1,303 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <istream>
+
+#include "sample_format.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * Decoders for a single sample. Assemble the integer value from individual
+ * bytes, which makes them independent of the byte order of the host.
+ */
+struct DecodeS16LE {
+	static constexpr size_t SIZE = 2;
+	float operator()(const uint8_t *p) const
+	{
+		return int16_t(uint16_t(p[0] | (p[1] << 8))) * (1.0f / 32768.0f);
+	}
+};
+
+struct DecodeS16BE {
+	static constexpr size_t SIZE = 2;
+	float operator()(const uint8_t *p) const
+	{
+		return int16_t(uint16_t(p[1] | (p[0] << 8))) * (1.0f / 32768.0f);
+	}
+};
+
+struct DecodeS24LE {
+	static constexpr size_t SIZE = 3;
+	float operator()(const uint8_t *p) const
+	{
+		// Place the 24 bits in the upper bytes to sign-extend the value
+		return int32_t((uint32_t(p[0]) << 8) | (uint32_t(p[1]) << 16) |
+		               (uint32_t(p[2]) << 24)) *
+		       (1.0f / 2147483648.0f);
+	}
+};
+
+struct DecodeS24BE {
+	static constexpr size_t SIZE = 3;
+	float operator()(const uint8_t *p) const
+	{
+		return int32_t((uint32_t(p[2]) << 8) | (uint32_t(p[1]) << 16) |
+		               (uint32_t(p[0]) << 24)) *
+		       (1.0f / 2147483648.0f);
+	}
+};
+
+static uint32_t load_u32le(const uint8_t *p)
+{
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) |
+	       (uint32_t(p[3]) << 24);
+}
+
+static uint32_t load_u32be(const uint8_t *p)
+{
+	return uint32_t(p[3]) | (uint32_t(p[2]) << 8) | (uint32_t(p[1]) << 16) |
+	       (uint32_t(p[0]) << 24);
+}
+
+static uint64_t load_u64le(const uint8_t *p)
+{
+	return uint64_t(load_u32le(p)) | (uint64_t(load_u32le(p + 4)) << 32);
+}
+
+static uint64_t load_u64be(const uint8_t *p)
+{
+	return uint64_t(load_u32be(p + 4)) | (uint64_t(load_u32be(p)) << 32);
+}
+
+struct DecodeS32LE {
+	static constexpr size_t SIZE = 4;
+	float operator()(const uint8_t *p) const
+	{
+		return int32_t(load_u32le(p)) * (1.0f / 2147483648.0f);
+	}
+};
+
+struct DecodeS32BE {
+	static constexpr size_t SIZE = 4;
+	float operator()(const uint8_t *p) const
+	{
+		return int32_t(load_u32be(p)) * (1.0f / 2147483648.0f);
+	}
+};
+
+struct DecodeF32LE {
+	static constexpr size_t SIZE = 4;
+	float operator()(const uint8_t *p) const
+	{
+		const uint32_t u = load_u32le(p);
+		float f;
+		memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+};
+
+struct DecodeF32BE {
+	static constexpr size_t SIZE = 4;
+	float operator()(const uint8_t *p) const
+	{
+		const uint32_t u = load_u32be(p);
+		float f;
+		memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+};
+
+struct DecodeF64LE {
+	static constexpr size_t SIZE = 8;
+	float operator()(const uint8_t *p) const
+	{
+		const uint64_t u = load_u64le(p);
+		double f;
+		memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+};
+
+struct DecodeF64BE {
+	static constexpr size_t SIZE = 8;
+	float operator()(const uint8_t *p) const
+	{
+		const uint64_t u = load_u64be(p);
+		double f;
+		memcpy(&f, &u, sizeof(f));
+		return f;
+	}
+};
+
+/**
+ * Converts n samples using the given decoder. Each block of samples is
+ * decoded into a temporary before it is written to the target, which allows
+ * the conversion to take place in place (see convert_samples()).
+ */
+template <typename Decode>
+static void convert(const uint8_t *src, float *tar, size_t n)
+{
+	static constexpr size_t LANES = 8;
+	const Decode decode;
+	float tmp[LANES];
+	size_t i = 0;
+	for (; i + LANES <= n; i += LANES) {
+		for (size_t j = 0; j < LANES; j++) {
+			tmp[j] = decode(src + (i + j) * Decode::SIZE);
+		}
+		for (size_t j = 0; j < LANES; j++) {
+			tar[i + j] = tmp[j];
+		}
+	}
+	for (; i < n; i++) {
+		tar[i] = decode(src + i * Decode::SIZE);
+	}
+}
+
+size_t sample_size(SampleFormat format)
+{
+	switch (format) {
+		case SampleFormat::S16LE:
+		case SampleFormat::S16BE:
+			return 2;
+		case SampleFormat::S24LE:
+		case SampleFormat::S24BE:
+			return 3;
+		case SampleFormat::S32LE:
+		case SampleFormat::S32BE:
+		case SampleFormat::F32LE:
+		case SampleFormat::F32BE:
+			return 4;
+		case SampleFormat::F64LE:
+		case SampleFormat::F64BE:
+			break;
+	}
+	return 8;
+}
+
+void convert_samples(const uint8_t *src, float *tar, size_t n,
+                     SampleFormat format)
+{
+	switch (format) {
+		case SampleFormat::S16LE:
+			return convert<DecodeS16LE>(src, tar, n);
+		case SampleFormat::S16BE:
+			return convert<DecodeS16BE>(src, tar, n);
+		case SampleFormat::S24LE:
+			return convert<DecodeS24LE>(src, tar, n);
+		case SampleFormat::S24BE:
+			return convert<DecodeS24BE>(src, tar, n);
+		case SampleFormat::S32LE:
+			return convert<DecodeS32LE>(src, tar, n);
+		case SampleFormat::S32BE:
+			return convert<DecodeS32BE>(src, tar, n);
+		case SampleFormat::F32LE:
+			return convert<DecodeF32LE>(src, tar, n);
+		case SampleFormat::F32BE:
+			return convert<DecodeF32BE>(src, tar, n);
+		case SampleFormat::F64LE:
+			return convert<DecodeF64LE>(src, tar, n);
+		case SampleFormat::F64BE:
+			return convert<DecodeF64BE>(src, tar, n);
+	}
+}
+
+void mix_to_mono(const float *src, float *tar, size_t n, size_t channels)
+{
+	const float scale = 1.0f / channels;
+	for (size_t i = 0; i < n; i++) {
+		float sum = 0.0f;
+		for (size_t c = 0; c < channels; c++) {
+			sum += src[i * channels + c];
+		}
+		tar[i] = sum * scale;
+	}
+}
+
+/******************************************************************************
+ * Class SampleReader                                                         *
+ ******************************************************************************/
+
+constexpr size_t SampleReader::BLOCK_SIZE;
+
+SampleReader::SampleReader(std::istream &is, SampleFormat format,
+                           size_t channels_in, size_t channels_out)
+    : m_is(is),
+      m_format(format),
+      m_size(sample_size(format)),
+      m_channels_in(channels_in),
+      m_channels_out(channels_out)
+{
+	assert(channels_out == channels_in || channels_out == 1);
+
+	// A staging buffer is only needed if the RAW data does not fit into the
+	// target buffer
+	if (channels_in != channels_out || m_size > sizeof(float)) {
+		m_buf.resize(BLOCK_SIZE * channels_in *
+		             std::max(m_size, sizeof(float)) / sizeof(float));
+	}
+}
+
+size_t SampleReader::read_raw(float *tar, size_t n)
+{
+	// Read the RAW data into the end of the target buffer, such that the
+	// conversion can take place in place
+	const size_t n_values = n * m_channels_in;
+	uint8_t *raw = reinterpret_cast<uint8_t *>(tar);
+	if (m_size < sizeof(float)) {
+		raw += n_values * (sizeof(float) - m_size);
+	}
+	m_is.read(reinterpret_cast<char *>(raw), n_values * m_size);
+	const size_t n_read = m_is.gcount() / (m_size * m_channels_in);
+	convert_samples(raw, tar, n_read * m_channels_in, m_format);
+	return n_read;
+}
+
+size_t SampleReader::read(float *tar, size_t n_tar)
+{
+	// Convert directly within the target buffer if possible
+	if (m_buf.empty()) {
+		return read_raw(tar, n_tar);
+	}
+
+	// Otherwise convert block-wise and mix the channels down if requested
+	size_t n = 0;
+	while (n < n_tar) {
+		const size_t n_block = std::min(BLOCK_SIZE, n_tar - n);
+		const size_t n_read = read_raw(m_buf.data(), n_block);
+		float *out = tar + n * m_channels_out;
+		if (m_channels_out == m_channels_in) {
+			std::copy(m_buf.begin(), m_buf.begin() + n_read * m_channels_in,
+			          out);
+		}
+		else {
+			mix_to_mono(m_buf.data(), out, n_read, m_channels_in);
+		}
+		n += n_read;
+		if (n_read < n_block) {
+			break;
+		}
+	}
+	return n;
+}
+}
+}
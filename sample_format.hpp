@@ -0,0 +1,148 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file sample_format.hpp
+ *
+ * Declares the supported RAW input sample formats, conversion functions from
+ * these formats to floating point samples, and the SampleReader class which
+ * reads RAW samples from an input stream.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace eolian {
+namespace stream {
+/**
+ * Enum describing the encoding of RAW audio samples. Signed integer samples
+ * are scaled to the range [-1, 1). 24 bit samples are packed into three bytes.
+ */
+enum class SampleFormat {
+	S16LE,
+	S16BE,
+	S24LE,
+	S24BE,
+	S32LE,
+	S32BE,
+	F32LE,
+	F32BE,
+	F64LE,
+	F64BE
+};
+
+/**
+ * Returns the size of a single sample in the given format in bytes.
+ */
+size_t sample_size(SampleFormat format);
+
+/**
+ * Converts the given samples to floating point. The conversion is independent
+ * of the byte order of the host and processes several samples at once, which
+ * allows the compiler to vectorise it. Source and target may overlap if the
+ * source ends at the same address as the target or later, i.e. if
+ * src >= (uint8_t *)tar + n * (sizeof(float) - sample_size(format)) for
+ * samples narrower than a float and src == (uint8_t *)tar otherwise.
+ *
+ * @param src is a pointer at the RAW samples.
+ * @param tar is a pointer at the target buffer with space for n values.
+ * @param n is the number of values to convert, i.e. the number of
+ * multi-channel samples times the number of channels.
+ * @param format is the format of the RAW samples.
+ */
+void convert_samples(const uint8_t *src, float *tar, size_t n,
+                     SampleFormat format);
+
+/**
+ * Mixes the given interleaved samples down to mono by averaging all channels.
+ *
+ * @param src is a pointer at the interleaved samples.
+ * @param tar is the target buffer with space for n mono samples.
+ * @param n is the number of multi-channel samples.
+ * @param channels is the number of interleaved channels in src.
+ */
+void mix_to_mono(const float *src, float *tar, size_t n, size_t channels);
+
+/**
+ * The SampleReader class reads RAW samples in any of the supported formats
+ * from an input stream and converts them to interleaved floating point
+ * samples, optionally mixing all channels down to mono. If no downmix is
+ * required and a sample is not larger than a float, the RAW data is read into
+ * the target buffer and converted in place; otherwise the data is converted
+ * block-wise using a small staging buffer.
+ */
+class SampleReader {
+private:
+	std::istream &m_is;
+	SampleFormat m_format;
+	size_t m_size;
+	size_t m_channels_in;
+	size_t m_channels_out;
+
+	/**
+	 * Staging buffer holding one block of samples.
+	 */
+	std::vector<float> m_buf;
+
+	/**
+	 * Reads up to n multi-channel samples and converts them in place.
+	 *
+	 * @param tar is the target buffer. Must provide space for n samples
+	 * in the input format or as floats, whichever is larger.
+	 * @param n is the number of multi-channel samples to read.
+	 * @return the number of samples that have actually been read.
+	 */
+	size_t read_raw(float *tar, size_t n);
+
+public:
+	/**
+	 * Number of multi-channel samples converted at once when a staging
+	 * buffer is required.
+	 */
+	static constexpr size_t BLOCK_SIZE = 1024;
+
+	/**
+	 * Creates a new SampleReader instance.
+	 *
+	 * @param is is the input stream the RAW samples are read from.
+	 * @param format is the format of the RAW samples.
+	 * @param channels_in is the number of interleaved channels in the stream.
+	 * @param channels_out is the number of channels returned by read(). Must
+	 * either be equal to channels_in or one.
+	 */
+	SampleReader(std::istream &is, SampleFormat format, size_t channels_in,
+	             size_t channels_out);
+
+	/**
+	 * Reads and converts samples from the input stream.
+	 *
+	 * @param tar is the buffer into which the samples should be written.
+	 * @param n_tar is the number of multi-channel samples to read.
+	 * @return the number of samples that have actually been read. A value
+	 * smaller than n_tar marks the end of the stream.
+	 */
+	size_t read(float *tar, size_t n_tar);
+};
+}
+}
@@ -0,0 +1,214 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "signal_classifier.hpp"
+
+namespace eolian {
+namespace stream {
+/******************************************************************************
+ * Class SignalClassifier                                                     *
+ ******************************************************************************/
+
+constexpr float SignalClassifier::FRAME_DURATION;
+constexpr float SignalClassifier::SILENCE;
+constexpr size_t SignalClassifier::PITCH_RATE;
+constexpr size_t SignalClassifier::PITCH_MIN;
+constexpr size_t SignalClassifier::PITCH_MAX;
+constexpr float SignalClassifier::VOICING_THRESHOLD;
+constexpr float SignalClassifier::ZCR_VARIATION_THRESHOLD;
+constexpr float SignalClassifier::FLUX_THRESHOLD;
+constexpr float SignalClassifier::PITCH_STABILITY_THRESHOLD;
+
+/**
+ * Returns the smallest power of two larger or equal to x.
+ */
+static size_t next_pow2(size_t x)
+{
+	size_t res = 1;
+	while (res < x) {
+		res *= 2;
+	}
+	return res;
+}
+
+SignalClassifier::SignalClassifier(size_t rate, size_t channels)
+    : m_rate(rate),
+      m_channels(channels),
+      m_frame_size(rate * FRAME_DURATION),
+      m_decimation(std::max<size_t>(1, rate / PITCH_RATE)),
+      m_spectrum(next_pow2(m_frame_size)),
+      m_power(m_spectrum.n_bins()),
+      m_mag(m_spectrum.n_bins()),
+      m_prev_mag(m_spectrum.n_bins()),
+      m_pitch_buf(m_frame_size / m_decimation)
+{
+}
+
+void SignalClassifier::reset()
+{
+	m_has_prev_mag = false;
+	m_prev_lag = 0;
+	m_n_frames = 0;
+	m_zcr_sum = 0.0;
+	m_zcr_sq_sum = 0.0;
+	m_flux_sum = 0.0;
+	m_n_flux = 0;
+	m_n_voiced_pairs = 0;
+	m_n_stable = 0;
+}
+
+size_t SignalClassifier::pitch_lag() const
+{
+	// Search the maximum of the normalised autocorrelation of the decimated
+	// signal within the range of expected pitch lags
+	const size_t rate = m_rate / m_decimation;
+	const size_t n = m_pitch_buf.size();
+	const size_t lag_min = rate / PITCH_MAX;
+	const size_t lag_max = std::min(rate / PITCH_MIN, n / 2);
+	const float *x = m_pitch_buf.data();
+	size_t best_lag = 0;
+	float best_corr = VOICING_THRESHOLD;
+	for (size_t lag = lag_min; lag <= lag_max; lag++) {
+		float xy = 0.0f, xx = 0.0f, yy = 0.0f;
+		for (size_t i = 0; i + lag < n; i++) {
+			xy += x[i] * x[i + lag];
+			xx += x[i] * x[i];
+			yy += x[i + lag] * x[i + lag];
+		}
+		const float corr = (xx > 0.0f && yy > 0.0f) ? xy / std::sqrt(xx * yy)
+		                                            : 0.0f;
+		if (corr > best_corr) {
+			best_corr = corr;
+			best_lag = lag;
+		}
+	}
+	return best_lag;
+}
+
+void SignalClassifier::analyse_frame(const float *src)
+{
+	// Mix down to mono, compute the energy and the zero-crossing rate, and
+	// decimate the signal for the pitch analysis
+	const float scale = 1.0f / m_channels;
+	double energy = 0.0;
+	size_t n_zc = 0;
+	float prev = 0.0f;
+	std::fill(m_pitch_buf.begin(), m_pitch_buf.end(), 0.0f);
+	for (size_t i = 0; i < m_frame_size; i++) {
+		float x = 0.0f;
+		for (size_t j = 0; j < m_channels; j++) {
+			x += src[i * m_channels + j];
+		}
+		x *= scale;
+		energy += x * x;
+		if (i > 0 && (x >= 0.0f) != (prev >= 0.0f)) {
+			n_zc++;
+		}
+		prev = x;
+		if (i / m_decimation < m_pitch_buf.size()) {
+			m_pitch_buf[i / m_decimation] += x;
+		}
+	}
+	if (energy / m_frame_size < SILENCE) {
+		m_has_prev_mag = false;
+		m_prev_lag = 0;
+		return;
+	}
+
+	// Accumulate the zero-crossing rate statistics
+	const double zcr = double(n_zc) / m_frame_size;
+	m_n_frames++;
+	m_zcr_sum += zcr;
+	m_zcr_sq_sum += zcr * zcr;
+
+	// Compute the normalised magnitude spectrum and the spectral flux
+	m_spectrum.compute(src, m_frame_size, m_channels, m_power.data());
+	double sum = 0.0;
+	for (size_t i = 0; i < m_power.size(); i++) {
+		sum += m_power[i];
+	}
+	const float norm = (sum > 0.0) ? 1.0 / std::sqrt(sum) : 0.0;
+	for (size_t i = 0; i < m_power.size(); i++) {
+		m_mag[i] = std::sqrt(m_power[i]) * norm;
+	}
+	if (m_has_prev_mag) {
+		float flux = 0.0f;
+		for (size_t i = 0; i < m_mag.size(); i++) {
+			const float d = m_mag[i] - m_prev_mag[i];
+			flux += d * d;
+		}
+		m_flux_sum += flux;
+		m_n_flux++;
+	}
+	std::swap(m_mag, m_prev_mag);
+	m_has_prev_mag = true;
+
+	// Compare the pitch with the pitch of the previous frame
+	const size_t lag = pitch_lag();
+	if (lag > 0 && m_prev_lag > 0) {
+		m_n_voiced_pairs++;
+		if (lag + 1 >= m_prev_lag && lag <= m_prev_lag + 1) {
+			m_n_stable++;
+		}
+	}
+	m_prev_lag = lag;
+}
+
+void SignalClassifier::analyse(const float *src, size_t n_src)
+{
+	for (size_t i = 0; i + m_frame_size <= n_src; i += m_frame_size) {
+		analyse_frame(src + i * m_channels);
+	}
+}
+
+float SignalClassifier::zcr_variation() const
+{
+	if (m_n_frames == 0) {
+		return 0.0f;
+	}
+	const double mean = m_zcr_sum / m_n_frames;
+	const double var = std::max(0.0, m_zcr_sq_sum / m_n_frames - mean * mean);
+	return (mean > 0.0) ? std::sqrt(var) / mean : 0.0f;
+}
+
+float SignalClassifier::spectral_flux() const
+{
+	return (m_n_flux == 0) ? 0.0f : m_flux_sum / m_n_flux;
+}
+
+float SignalClassifier::pitch_stability() const
+{
+	return (m_n_voiced_pairs == 0) ? 1.0f
+	                               : float(m_n_stable) / m_n_voiced_pairs;
+}
+
+bool SignalClassifier::speech() const
+{
+	if (m_n_frames == 0) {
+		return false;
+	}
+	const size_t votes = (zcr_variation() > ZCR_VARIATION_THRESHOLD) +
+	                     (spectral_flux() > FLUX_THRESHOLD) +
+	                     (pitch_stability() < PITCH_STABILITY_THRESHOLD);
+	return votes >= 2;
+}
+}
+}
@@ -0,0 +1,195 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file signal_classifier.hpp
+ *
+ * Declares the SignalClassifier class which distinguishes between speech and
+ * music signals.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "encoder.hpp"
+#include "power_spectrum.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The SignalClassifier class decides whether a signal is speech or music
+ * based on three features computed over 40 ms analysis frames:
+ *
+ * - Zero-crossing rate variation. Speech alternates between voiced and
+ *   unvoiced sounds, which yields a large relative standard deviation of the
+ *   zero-crossing rate.
+ * - Spectral flux. The spectral envelope of speech changes with every
+ *   phoneme, while music tends to be spectrally stationary over a note.
+ * - Pitch stability. Musical notes hold their pitch, whereas the pitch of
+ *   speech glides continuously and is interrupted by unvoiced sounds.
+ *
+ * Each feature casts a vote; the signal is classified as speech if at least
+ * two features vote for speech. Silent frames are ignored.
+ */
+class SignalClassifier {
+private:
+	size_t m_rate;
+	size_t m_channels;
+
+	/**
+	 * Number of samples in each analysis frame.
+	 */
+	size_t m_frame_size;
+
+	/**
+	 * Decimation factor used for the pitch analysis.
+	 */
+	size_t m_decimation;
+
+	/**
+	 * FFT used for the spectral flux and the normalised magnitude spectra of
+	 * the current and the previous frame.
+	 */
+	PowerSpectrum m_spectrum;
+	std::vector<float> m_power;
+	std::vector<float> m_mag;
+	std::vector<float> m_prev_mag;
+	bool m_has_prev_mag = false;
+
+	/**
+	 * Decimated mono signal of the current frame used for pitch detection.
+	 */
+	std::vector<float> m_pitch_buf;
+
+	/**
+	 * Pitch lag of the previous frame, zero if the frame was unvoiced.
+	 */
+	size_t m_prev_lag = 0;
+
+	/**
+	 * Accumulated statistics.
+	 */
+	size_t m_n_frames = 0;
+	double m_zcr_sum = 0.0;
+	double m_zcr_sq_sum = 0.0;
+	double m_flux_sum = 0.0;
+	size_t m_n_flux = 0;
+	size_t m_n_voiced_pairs = 0;
+	size_t m_n_stable = 0;
+
+	/**
+	 * Returns the pitch lag of the current frame in decimated samples or zero
+	 * if the frame is unvoiced.
+	 */
+	size_t pitch_lag() const;
+
+	/**
+	 * Analyses a single frame.
+	 */
+	void analyse_frame(const float *src);
+
+public:
+	/**
+	 * Duration of a single analysis frame in seconds.
+	 */
+	static constexpr float FRAME_DURATION = 0.04f;
+
+	/**
+	 * Frames with a mean square below this value are considered silent.
+	 */
+	static constexpr float SILENCE = 1e-6f;
+
+	/**
+	 * Sample rate used for the pitch analysis and the range of detected
+	 * fundamental frequencies in Hz.
+	 */
+	static constexpr size_t PITCH_RATE = 8000;
+	static constexpr size_t PITCH_MIN = 70;
+	static constexpr size_t PITCH_MAX = 400;
+
+	/**
+	 * Minimum normalised autocorrelation for a frame to be considered voiced.
+	 */
+	static constexpr float VOICING_THRESHOLD = 0.7f;
+
+	/**
+	 * Feature thresholds above (zero-crossing rate variation, spectral flux)
+	 * or below (pitch stability) which a feature votes for speech.
+	 */
+	static constexpr float ZCR_VARIATION_THRESHOLD = 0.4f;
+	static constexpr float FLUX_THRESHOLD = 0.2f;
+	static constexpr float PITCH_STABILITY_THRESHOLD = 0.5f;
+
+	/**
+	 * Creates a new SignalClassifier instance.
+	 *
+	 * @param rate is the sample rate of the signal.
+	 * @param channels is the number of interleaved channels.
+	 */
+	SignalClassifier(size_t rate, size_t channels);
+
+	/**
+	 * Discards the accumulated statistics.
+	 */
+	void reset();
+
+	/**
+	 * Adds the given signal to the accumulated statistics. Trailing samples
+	 * not filling an entire analysis frame are ignored.
+	 *
+	 * @param src is a pointer at the interleaved samples.
+	 * @param n_src is the number of multi-channel samples.
+	 */
+	void analyse(const float *src, size_t n_src);
+
+	/**
+	 * Relative standard deviation of the zero-crossing rate.
+	 */
+	float zcr_variation() const;
+
+	/**
+	 * Mean spectral flux between consecutive frames in the range [0, 2].
+	 */
+	float spectral_flux() const;
+
+	/**
+	 * Fraction of consecutive voiced frames with the same pitch. Returns one
+	 * if there are no consecutive voiced frames.
+	 */
+	float pitch_stability() const;
+
+	/**
+	 * Returns true if the analysed signal is classified as speech. Returns
+	 * false if no non-silent frame has been analysed.
+	 */
+	bool speech() const;
+
+	/**
+	 * Returns the signal type hint corresponding to the classification.
+	 */
+	Encoder::Signal signal() const
+	{
+		return speech() ? Encoder::Signal::VOICE : Encoder::Signal::MUSIC;
+	}
+};
+}
+}
@@ -0,0 +1,44 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <cstring>
+
+#include "silence.hpp"
+
+namespace eolian {
+namespace stream {
+float peak_amplitude(const float *src, size_t n)
+{
+	// Compare the bit patterns of the absolute values instead of the floats
+	// themselves. For non-negative IEEE 754 numbers both orders agree, and
+	// unlike the floating point comparison the integer maximum does not
+	// have to preserve NaN semantics, so the compiler vectorises the loop.
+	uint32_t peak = 0;
+	for (size_t i = 0; i < n; i++) {
+		uint32_t x;
+		std::memcpy(&x, &src[i], sizeof(x));
+		x &= 0x7FFFFFFF;
+		peak = (x > peak) ? x : peak;
+	}
+	float res;
+	std::memcpy(&res, &peak, sizeof(res));
+	return res;
+}
+}
+}
@@ -0,0 +1,56 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file silence.hpp
+ *
+ * Provides a fast peak amplitude scan used to detect silent frames and chunks.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace eolian {
+namespace stream {
+/**
+ * Returns the maximum absolute value in the given buffer.
+ *
+ * @param src is a pointer at the (interleaved) samples.
+ * @param n is the total number of values in the buffer, i.e. the number of
+ * multi-channel samples times the number of channels.
+ * @return the peak amplitude.
+ */
+float peak_amplitude(const float *src, size_t n);
+
+/**
+ * Returns true if the peak amplitude of the given buffer is below the given
+ * threshold. Always returns false if the threshold is zero.
+ *
+ * @param src is a pointer at the (interleaved) samples.
+ * @param n is the total number of values in the buffer.
+ * @param threshold is the peak amplitude below which the buffer is silent.
+ */
+inline bool is_silent(const float *src, size_t n, float threshold)
+{
+	return threshold > 0.0f && peak_amplitude(src, n) < threshold;
+}
+}
+}
@@ -0,0 +1,64 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits>
+
+#include "stereo.hpp"
+
+namespace eolian {
+namespace stream {
+float side_ratio(const float *src, size_t n)
+{
+	static constexpr size_t LANES = 4;
+	float mid[LANES] = {0.0f}, side[LANES] = {0.0f};
+	size_t i = 0;
+	for (; i + LANES <= n; i += LANES) {
+		for (size_t j = 0; j < LANES; j++) {
+			const float l = src[2 * (i + j)], r = src[2 * (i + j) + 1];
+			mid[j] += (l + r) * (l + r);
+			side[j] += (l - r) * (l - r);
+		}
+	}
+	for (; i < n; i++) {
+		const float l = src[2 * i], r = src[2 * i + 1];
+		mid[0] += (l + r) * (l + r);
+		side[0] += (l - r) * (l - r);
+	}
+
+	double e_mid = 0.0, e_side = 0.0;
+	for (size_t j = 0; j < LANES; j++) {
+		e_mid += mid[j];
+		e_side += side[j];
+	}
+	if (e_side == 0.0) {
+		return 0.0f;
+	}
+	if (e_mid == 0.0) {
+		return std::numeric_limits<float>::max();
+	}
+	return e_side / e_mid;
+}
+
+void downmix(const float *src, float *tar, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		tar[i] = 0.5f * (src[2 * i] + src[2 * i + 1]);
+	}
+}
+}
+}
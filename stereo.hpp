@@ -0,0 +1,55 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file stereo.hpp
+ *
+ * Provides functions for detecting and downmixing dual-mono stereo signals.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace eolian {
+namespace stream {
+/**
+ * Returns the energy of the side signal L - R relative to the energy of the
+ * mid signal L + R. The ratio is zero for identical channels. Returns zero if
+ * both energies are zero and a large value if only the mid energy is zero.
+ * The sums use several independent accumulators, which allows the compiler
+ * to vectorise them.
+ *
+ * @param src is a pointer at the interleaved stereo samples.
+ * @param n is the number of stereo samples.
+ */
+float side_ratio(const float *src, size_t n);
+
+/**
+ * Mixes the given interleaved stereo signal down to mono by averaging both
+ * channels.
+ *
+ * @param src is a pointer at the interleaved stereo samples.
+ * @param tar is the target buffer with space for n mono samples.
+ * @param n is the number of stereo samples.
+ */
+void downmix(const float *src, float *tar, size_t n);
+}
+}
@@ -0,0 +1,48 @@
+/**
+ * Joins a sequence of chunks written by opus_gapless into a single Ogg/Opus
+ * file.
+ *
+ * (c) Andreas Stöckel, 2017, licensed under AGPLv3 or later,
+ * see https://www.gnu.org/licenses/AGPLv3
+ */
+
+#include <exception>
+#include <fstream>
+#include <iostream>
+
+#include "chunk_stitcher.hpp"
+#include "chunk_validator.hpp"
+#include "mapped_file.hpp"
+
+using namespace eolian::stream;
+
+int main(int argc, char *argv[])
+{
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " OUTPUT CHUNK..." << std::endl;
+		return 1;
+	}
+
+	try {
+		// Read the chunks in the given order, each file may contain several
+		// concatenated chunks
+		ChunkStitcher stitcher;
+		for (int i = 2; i < argc; i++) {
+			const MappedFile file(argv[i]);
+			for (const auto &chunk : split_chunks(file.data(), file.size())) {
+				stitcher.push_back(file.data() + chunk.first, chunk.second);
+			}
+		}
+
+		std::ofstream os(argv[1], std::ios::binary);
+		stitcher.stitch(os);
+		std::cerr << "Stitched " << stitcher.size() << " chunks, copied "
+		          << stitcher.copied_packets() << " packets, re-encoded "
+		          << stitcher.encoded_packets() << " packets" << std::endl;
+	}
+	catch (const std::exception &e) {
+		std::cerr << argv[0] << ": " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,173 @@
+/**
+ * Verifies the integrity of the Ogg/Opus chunks written by opus_gapless.
+ *
+ * (c) Andreas Stöckel, 2017, licensed under AGPLv3 or later,
+ * see https://www.gnu.org/licenses/AGPLv3
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "chunk_validator.hpp"
+#include "mapped_file.hpp"
+
+using namespace eolian::stream;
+
+/**
+ * Result of validating a single file.
+ */
+struct Result {
+	size_t n_chunks = 0;
+	std::vector<std::string> errors;
+};
+
+/**
+ * Returns true if the given file name has one of the extensions used for
+ * Ogg/Opus files.
+ */
+static bool is_ogg_file(const std::string &name)
+{
+	for (const std::string ext : {".ogg", ".opus"}) {
+		if (name.size() > ext.size() &&
+		    name.compare(name.size() - ext.size(), ext.size(), ext) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Recursively collects all Ogg/Opus files in the given directory. Adds the
+ * path itself if it is not a directory.
+ */
+static void collect_files(const std::string &path,
+                          std::vector<std::string> &files)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+		files.push_back(path);
+		return;
+	}
+	DIR *dir = opendir(path.c_str());
+	if (!dir) {
+		files.push_back(path);
+		return;
+	}
+	std::vector<std::string> entries;
+	while (struct dirent *entry = readdir(dir)) {
+		const std::string name = entry->d_name;
+		if (name != "." && name != "..") {
+			entries.push_back(path + "/" + name);
+		}
+	}
+	closedir(dir);
+
+	// Visit the directory entries in a deterministic order
+	std::sort(entries.begin(), entries.end());
+	for (const std::string &entry : entries) {
+		if (stat(entry.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+			collect_files(entry, files);
+		}
+		else if (is_ogg_file(entry)) {
+			files.push_back(entry);
+		}
+	}
+}
+
+/**
+ * Validates all chunks stored in the given file.
+ */
+static Result validate_file(const std::string &filename)
+{
+	Result res;
+	try {
+		const MappedFile file(filename);
+		const auto chunks = split_chunks(file.data(), file.size());
+		res.n_chunks = chunks.size();
+
+		// Header-less chunks refer to the last init segment preceding them
+		ChunkInfo init;
+		bool has_init = false;
+		for (size_t i = 0; i < chunks.size(); i++) {
+			try {
+				const ChunkInfo info =
+				    validate_chunk(file.data() + chunks[i].first,
+				                   chunks[i].second, has_init ? &init : nullptr);
+				if (info.has_headers && info.n_packets == 0) {
+					init = info;
+					has_init = true;
+				}
+			}
+			catch (const std::exception &e) {
+				res.errors.push_back(
+				    (chunks.size() > 1
+				         ? filename + "[#" + std::to_string(i) + "]"
+				         : filename) +
+				    ": " + e.what());
+			}
+		}
+	}
+	catch (const std::exception &e) {
+		res.errors.push_back(filename + ": " + e.what());
+	}
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	// Parse the command line
+	size_t n_threads = std::max(1U, std::thread::hardware_concurrency());
+	std::vector<std::string> files;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			n_threads = std::max(1, atoi(argv[++i]));
+		}
+		else {
+			collect_files(argv[i], files);
+		}
+	}
+	if (files.empty()) {
+		std::cerr << "Usage: " << argv[0] << " [-j N] PATH..." << std::endl;
+		return 1;
+	}
+
+	// Validate the files in parallel; each worker repeatedly fetches the next
+	// file from the list
+	std::vector<Result> results(files.size());
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < std::min(n_threads, files.size()); i++) {
+		threads.emplace_back([&]() {
+			size_t idx;
+			while ((idx = next++) < files.size()) {
+				results[idx] = validate_file(files[idx]);
+			}
+		});
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	// Print the errors in the order of the files
+	size_t n_chunks = 0, n_errors = 0;
+	for (const Result &res : results) {
+		n_chunks += res.n_chunks;
+		n_errors += res.errors.size();
+		for (const std::string &error : res.errors) {
+			std::cout << error << std::endl;
+		}
+	}
+	std::cerr << "Validated " << n_chunks << " chunks in " << files.size()
+	          << " files, " << n_errors << " errors" << std::endl;
+	return (n_errors > 0) ? 1 : 0;
+}
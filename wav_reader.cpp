@@ -0,0 +1,300 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+#include "mapped_file.hpp"
+#include "wav_reader.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The WavError class is used to signal that a file cannot be opened or is not
+ * a supported WAV file.
+ */
+class WavError : public std::runtime_error {
+public:
+	WavError(const std::string &filename, const std::string &msg)
+	    : std::runtime_error(filename + ": " + msg)
+	{
+	}
+};
+
+static uint16_t load_u16le(const uint8_t *p)
+{
+	return uint16_t(p[0] | (p[1] << 8));
+}
+
+static uint32_t load_u32le(const uint8_t *p)
+{
+	return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) |
+	       (uint32_t(p[3]) << 24);
+}
+
+static uint64_t load_u64le(const uint8_t *p)
+{
+	return uint64_t(load_u32le(p)) | (uint64_t(load_u32le(p + 4)) << 32);
+}
+
+/**
+ * Suffix shared by the Wave64 GUIDs of the "wave", "fmt " and "data" chunks,
+ * which start with the corresponding four character code.
+ */
+static const uint8_t W64_GUID_SUFFIX[12] = {0xF3, 0xAC, 0xD3, 0x11,
+                                            0x8C, 0xD1, 0x00, 0xC0,
+                                            0x4F, 0x8E, 0xDB, 0x8A};
+
+/**
+ * GUID of the Wave64 "riff" chunk.
+ */
+static const uint8_t W64_GUID_RIFF[16] = {0x72, 0x69, 0x66, 0x66, 0x2E, 0x91,
+                                          0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB,
+                                          0x04, 0xC1, 0x00, 0x00};
+
+/**
+ * Returns true if the given Wave64 GUID corresponds to the given four
+ * character code.
+ */
+static bool is_w64_guid(const uint8_t *p, const char *fourcc)
+{
+	return memcmp(p, fourcc, 4) == 0 &&
+	       memcmp(p + 4, W64_GUID_SUFFIX, sizeof(W64_GUID_SUFFIX)) == 0;
+}
+
+/******************************************************************************
+ * Struct WavReader::Impl                                                     *
+ ******************************************************************************/
+
+struct WavReader::Impl {
+	/**
+	 * Number of multi-channel samples converted at once when mixing down to
+	 * mono.
+	 */
+	static constexpr size_t BLOCK_SIZE = 256;
+
+	/**
+	 * Maximum number of channels supported when mixing down to mono.
+	 */
+	static constexpr size_t MAX_CHANNELS = 8;
+
+	std::string filename;
+	MappedFile file;
+	const uint8_t *map;
+	size_t map_size;
+
+	size_t rate = 0;
+	size_t channels = 0;
+	SampleFormat format = SampleFormat::S16LE;
+	const uint8_t *data = nullptr;
+	size_t length = 0;
+
+	/**
+	 * Size of a single multi-channel sample in bytes.
+	 */
+	size_t frame_size = 0;
+
+	Impl(const std::string &filename)
+	    : filename(filename),
+	      file(filename),
+	      map(file.data()),
+	      map_size(file.size())
+	{
+		parse();
+	}
+
+	/**
+	 * Locates the format and data chunks in a RIFF/RF64 or Wave64 file.
+	 */
+	void parse()
+	{
+		const uint8_t *fmt = nullptr, *data_chunk = nullptr;
+		size_t fmt_size = 0, data_size = 0;
+		if (map_size >= 12 &&
+		    (memcmp(map, "RIFF", 4) == 0 || memcmp(map, "RF64", 4) == 0) &&
+		    memcmp(map + 8, "WAVE", 4) == 0) {
+			// RIFF chunks consist of a four character code and a 32 bit size
+			// and are padded to an even number of bytes. In RF64 files the
+			// size of the data chunk is stored in the leading "ds64" chunk.
+			const bool rf64 = memcmp(map, "RF64", 4) == 0;
+			uint64_t ds64_data_size = 0;
+			size_t offs = 12;
+			while (offs + 8 <= map_size) {
+				const uint8_t *chunk = map + offs;
+				uint64_t size = load_u32le(chunk + 4);
+				if (rf64 && memcmp(chunk, "ds64", 4) == 0 && size >= 16 &&
+				    offs + 24 <= map_size) {
+					ds64_data_size = load_u64le(chunk + 16);
+				}
+				else if (memcmp(chunk, "fmt ", 4) == 0) {
+					fmt = chunk + 8;
+					fmt_size = size;
+				}
+				else if (memcmp(chunk, "data", 4) == 0) {
+					if (rf64 && size == 0xFFFFFFFF) {
+						size = ds64_data_size;
+					}
+					data_chunk = chunk + 8;
+					data_size = size;
+					break;
+				}
+				offs += 8 + size + (size & 1);
+			}
+		}
+		else if (map_size >= 40 && memcmp(map, W64_GUID_RIFF, 16) == 0 &&
+		         is_w64_guid(map + 24, "wave")) {
+			// Wave64 chunks consist of a GUID and a 64 bit size including the
+			// chunk header and are aligned to eight bytes
+			size_t offs = 40;
+			while (offs + 24 <= map_size) {
+				const uint8_t *chunk = map + offs;
+				const uint64_t size = load_u64le(chunk + 16);
+				if (size < 24) {
+					break;
+				}
+				if (is_w64_guid(chunk, "fmt ")) {
+					fmt = chunk + 24;
+					fmt_size = size - 24;
+				}
+				else if (is_w64_guid(chunk, "data")) {
+					data_chunk = chunk + 24;
+					data_size = size - 24;
+					break;
+				}
+				offs += (size + 7) / 8 * 8;
+			}
+		}
+		else {
+			throw WavError(filename, "Not a WAV, RF64 or Wave64 file.");
+		}
+		if (!fmt || fmt_size < 16 || fmt + fmt_size > map + map_size) {
+			throw WavError(filename, "Missing or invalid format chunk.");
+		}
+		if (!data_chunk) {
+			throw WavError(filename, "Missing data chunk.");
+		}
+
+		// Parse the format chunk. The extensible format stores the actual
+		// format tag in the first two bytes of the sub-format GUID.
+		uint16_t tag = load_u16le(fmt);
+		channels = load_u16le(fmt + 2);
+		rate = load_u32le(fmt + 4);
+		const size_t block_align = load_u16le(fmt + 12);
+		const size_t bits = load_u16le(fmt + 14);
+		if (tag == 0xFFFE && fmt_size >= 40) {
+			tag = load_u16le(fmt + 24);
+		}
+		if (tag == 1 && bits == 16) {
+			format = SampleFormat::S16LE;
+		}
+		else if (tag == 1 && bits == 24) {
+			format = SampleFormat::S24LE;
+		}
+		else if (tag == 1 && bits == 32) {
+			format = SampleFormat::S32LE;
+		}
+		else if (tag == 3 && bits == 32) {
+			format = SampleFormat::F32LE;
+		}
+		else if (tag == 3 && bits == 64) {
+			format = SampleFormat::F64LE;
+		}
+		else {
+			throw WavError(filename, "Unsupported sample format.");
+		}
+		frame_size = channels * sample_size(format);
+		if (channels == 0 || rate == 0 || block_align != frame_size) {
+			throw WavError(filename, "Invalid format chunk.");
+		}
+
+		// Clamp the data chunk to the actual file size, e.g. for files that
+		// are still being written
+		data = data_chunk;
+		data_size = std::min<uint64_t>(data_size, map + map_size - data_chunk);
+		length = data_size / frame_size;
+	}
+};
+
+constexpr size_t WavReader::Impl::BLOCK_SIZE;
+constexpr size_t WavReader::Impl::MAX_CHANNELS;
+
+/******************************************************************************
+ * Class WavReader                                                            *
+ ******************************************************************************/
+
+WavReader::WavReader(const std::string &filename)
+    : m_impl(new Impl(filename))
+{
+}
+
+WavReader::~WavReader()
+{
+	// Implicitly destroy m_impl
+}
+
+size_t WavReader::rate() const { return m_impl->rate; }
+
+size_t WavReader::channels() const { return m_impl->channels; }
+
+SampleFormat WavReader::format() const { return m_impl->format; }
+
+size_t WavReader::length() const { return m_impl->length; }
+
+const uint8_t *WavReader::data() const { return m_impl->data; }
+
+size_t WavReader::read(size_t offs, float *tar, size_t n_tar,
+                       size_t channels) const
+{
+	const Impl &impl = *m_impl;
+	assert(channels == 0 || channels == impl.channels || channels == 1);
+	const size_t n = (offs < impl.length) ? std::min(n_tar, impl.length - offs)
+	                                      : 0;
+	const uint8_t *src = impl.data + offs * impl.frame_size;
+
+	// Convert all channels directly from the mapped file
+	if (channels == 0 || channels == impl.channels) {
+		convert_samples(src, tar, n * impl.channels, impl.format);
+		return n;
+	}
+
+	// Convert block-wise and mix down to mono
+	if (impl.channels > Impl::MAX_CHANNELS) {
+		throw WavError(impl.filename, "Too many channels to mix down.");
+	}
+	float buf[Impl::BLOCK_SIZE * Impl::MAX_CHANNELS];
+	for (size_t i = 0; i < n; i += Impl::BLOCK_SIZE) {
+		const size_t n_block = std::min(Impl::BLOCK_SIZE, n - i);
+		convert_samples(src + i * impl.frame_size, buf,
+		                n_block * impl.channels, impl.format);
+		mix_to_mono(buf, tar + i, n_block, impl.channels);
+	}
+	return n;
+}
+
+WavReader::Callback WavReader::source(size_t offs, size_t channels) const
+{
+	return [this, offs, channels](float *buf, size_t buf_size) mutable {
+		const size_t n = read(offs, buf, buf_size, channels);
+		offs += n;
+		return n;
+	};
+}
+}
+}
@@ -0,0 +1,131 @@
+/*
+ *  EOLIAN Web Music Player
+ *  Copyright (C) 2017  Andreas Stöckel
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as
+ *  published by the Free Software Foundation, either version 3 of the
+ *  License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file wav_reader.hpp
+ *
+ * Declares the WavReader class which provides random access to the samples
+ * stored in a WAV, RF64, or Sony Wave64 file.
+ *
+ * @author Andreas Stöckel
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "sample_format.hpp"
+
+namespace eolian {
+namespace stream {
+/**
+ * The WavReader class maps a WAV (including BWF), RF64 or Sony Wave64 file
+ * into memory, locates the format and data chunks and converts samples from
+ * arbitrary positions within the file to floating point. Supported encodings
+ * are 16, 24 and 32 bit integer PCM as well as 32 and 64 bit floating point
+ * samples, either using the plain or the extensible format descriptor.
+ *
+ * Since the samples are converted directly from the mapped file and
+ * read() does not modify the WavReader instance, several threads may read
+ * from the same instance concurrently, e.g. to encode chunks in parallel.
+ */
+class WavReader {
+private:
+	struct Impl;
+	std::unique_ptr<Impl> m_impl;
+
+public:
+	/**
+	 * Callback reading consecutive samples, compatible with
+	 * ChunkTranscoder::DecoderCallback.
+	 */
+	using Callback = std::function<size_t(float *buf, size_t buf_size)>;
+
+	/**
+	 * Opens and maps the given file and parses its headers. Throws an
+	 * exception if the file cannot be opened or is not a supported WAV file.
+	 *
+	 * @param filename is the name of the file that should be opened.
+	 */
+	explicit WavReader(const std::string &filename);
+
+	/**
+	 * Unmaps and closes the file.
+	 */
+	~WavReader();
+
+	/**
+	 * Returns the sample rate stored in the file header.
+	 */
+	size_t rate() const;
+
+	/**
+	 * Returns the number of interleaved channels.
+	 */
+	size_t channels() const;
+
+	/**
+	 * Returns the format of the samples in the data chunk.
+	 */
+	SampleFormat format() const;
+
+	/**
+	 * Returns the number of multi-channel samples in the data chunk.
+	 */
+	size_t length() const;
+
+	/**
+	 * Returns a pointer at the RAW samples in the mapped data chunk.
+	 */
+	const uint8_t *data() const;
+
+	/**
+	 * Converts samples starting at the given position to floating point.
+	 *
+	 * @param offs is the index of the first multi-channel sample that should
+	 * be read.
+	 * @param tar is the buffer into which the samples should be written.
+	 * @param n_tar is the number of multi-channel samples to read.
+	 * @param channels is the number of channels that should be written to
+	 * tar. Must either be zero or equal to channels() to read all channels,
+	 * or one to mix all channels down to mono.
+	 * @return the number of samples that have actually been read, which is
+	 * smaller than n_tar if the end of the data chunk has been reached.
+	 */
+	size_t read(size_t offs, float *tar, size_t n_tar,
+	            size_t channels = 0) const;
+
+	/**
+	 * Returns a callback reading consecutive samples, starting at the given
+	 * position. The callback can be passed to the ChunkTranscoder along with
+	 * the same offset as decoder offset. The WavReader instance must outlive
+	 * the callback.
+	 *
+	 * @param offs is the index of the first multi-channel sample returned by
+	 * the callback.
+	 * @param channels is the number of channels returned by the callback,
+	 * see read().
+	 */
+	Callback source(size_t offs = 0, size_t channels = 0) const;
+};
+}
+}